@@ -1,12 +1,56 @@
 import numpy as np
+from multiprocessing import shared_memory
 
+# float32 data is widened to float64 this many elements at a time, the same
+# block size the C workers use.
+BLOCK_SIZE = 1 << 16
 
-def compute_sum_of_squares_pipe(data_segment, results_queue):
-    result = sum(x**2 for x in data_segment)
-    results_queue.put(result)
 
+def sum_of_squares(segment):
+    """Sum of squares accumulated in float64, like the C kernel."""
+    if segment.dtype == np.float64:
+        return float(np.dot(segment, segment))
+    total = 0.0
+    for start in range(0, len(segment), BLOCK_SIZE):
+        block = segment[start:start + BLOCK_SIZE].astype(np.float64)
+        total += float(np.dot(block, block))
+    return total
 
-def compute_sum_of_squares_shm(data_segment, global_sum, lock):
-    result = sum(x ** 2 for x in data_segment)
-    with lock:
-        global_sum[0] += result
+
+def attach_shared_memory(name):
+    # The parent owns and unlinks the segment, so children must not let the
+    # resource tracker clean it up when they exit (track= is Python 3.13+).
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)
+    except TypeError:
+        return shared_memory.SharedMemory(name=name)
+
+
+def input_view(source, dtype, start, end):
+    """Zero-copy view of elements start..end of the input. source is
+    (name, offset, is_file): a shared memory segment, or a binary input file
+    mapped directly."""
+    name, offset, is_file = source
+    offset += start * np.dtype(dtype).itemsize
+    if is_file:
+        return None, np.memmap(name, dtype=dtype, mode='r', offset=offset, shape=(end - start,))
+    shm = attach_shared_memory(name)
+    return shm, np.ndarray((end - start,), dtype=dtype, buffer=shm.buf, offset=offset)
+
+
+def compute_sum_of_squares_pipe(conn, count, dtype):
+    buffer = bytearray(count * np.dtype(dtype).itemsize)
+    conn.recv_bytes_into(buffer)
+    conn.send(sum_of_squares(np.frombuffer(buffer, dtype=dtype)))
+    conn.close()
+
+
+def compute_sum_of_squares_shm(source, dtype, start, end, results_name, index):
+    shm, segment = input_view(source, dtype, start, end)
+    results = attach_shared_memory(results_name)
+    sums = np.ndarray((index + 1,), dtype=np.float64, buffer=results.buf)
+    sums[index] = sum_of_squares(segment)
+    del sums, segment
+    results.close()
+    if shm is not None:
+        shm.close()
@@ -1,28 +1,136 @@
+import os
+import struct
 import sys
+import multiprocessing
 import numpy as np
-import threading
-import queue
+from multiprocessing import shared_memory
 from child_process import compute_sum_of_squares_pipe, compute_sum_of_squares_shm
-from threading import Lock
 
+# Header of the binary files written by linux/convert_numbers.
+BINARY_MAGIC = b"SPNUMBIN"
+BINARY_HEADER = struct.Struct("8sIHHQQ")
+BINARY_BYTE_ORDER = 0x01020304
+ELEMENT_TYPES = {1: 'f4', 2: 'f8'}
 
-def main(file_name, num_threads, ipc_method):
+
+class BinaryFormatError(ValueError):
+    pass
+
+
+def read_binary(file_name, header, file_size):
+    """Maps the data of a binary input file without copying it. Returns the
+    array and its offset in the file, or raises BinaryFormatError."""
+    for order in '<>':
+        magic, byte_order, version, element_type, count, data_offset = struct.unpack(
+            order + BINARY_HEADER.format, header[:BINARY_HEADER.size])
+        if byte_order == BINARY_BYTE_ORDER:
+            break
+    else:
+        raise BinaryFormatError("unknown byte order marker")
+    if version != 1:
+        raise BinaryFormatError("unsupported format version")
+    if element_type not in ELEMENT_TYPES:
+        raise BinaryFormatError("unsupported element type")
+    dtype = np.dtype(order + ELEMENT_TYPES[element_type])
+    if data_offset < len(header) or data_offset % dtype.itemsize or data_offset > file_size \
+            or count > (file_size - data_offset) // dtype.itemsize:
+        raise BinaryFormatError("header does not match the file size")
+    if count == 0:
+        return np.empty(0, dtype=dtype), data_offset
+    return np.memmap(file_name, dtype=dtype, mode='r', offset=data_offset, shape=(count,)), data_offset
+
+
+def read_numbers(file_name, element_type):
+    with open(file_name, 'rb') as f:
+        header = f.read(64)
+        if len(header) == 64 and header[:len(BINARY_MAGIC)] == BINARY_MAGIC:
+            return read_binary(file_name, header, os.fstat(f.fileno()).st_size)
+        f.seek(0)
+        tokens = f.read().split()
     try:
-        with open(file_name, 'r') as f:
-            numbers = np.array([float(x) for x in f.read().split()], dtype=np.float64)
+        return np.array(tokens, dtype=element_type), None
+    except ValueError:
+        # Like the C parser, stop at the first token that is not a number.
+        valid = 0
+        for token in tokens:
+            try:
+                float(token)
+            except ValueError:
+                break
+            valid += 1
+        return np.array(tokens[:valid], dtype=element_type), None
+
+
+def run_pipe(ctx, numbers, starts, ends):
+    children = []
+    for start, end in zip(starts, ends):
+        parent_conn, child_conn = ctx.Pipe()
+        process = ctx.Process(target=compute_sum_of_squares_pipe, args=(child_conn, end - start, numbers.dtype.str))
+        process.start()
+        child_conn.close()
+        children.append((process, parent_conn))
+
+    for (process, conn), start, end in zip(children, starts, ends):
+        conn.send_bytes(memoryview(numbers[start:end]).cast('B'))
+    sums = [conn.recv() for _, conn in children]
+    for process, conn in children:
+        conn.close()
+        process.join()
+    return sums, [process.exitcode for process, _ in children]
+
+
+def run_shm(ctx, file_name, numbers, data_offset, starts, ends):
+    """Binary input is mapped by the children straight from the file; text
+    is parsed once into a shared memory segment they all view."""
+    segment = None
+    if data_offset is not None:
+        source = (file_name, data_offset, True)
+    else:
+        segment = shared_memory.SharedMemory(create=True, size=max(numbers.nbytes, 1))
+        np.ndarray(numbers.shape, dtype=numbers.dtype, buffer=segment.buf)[:] = numbers
+        source = (segment.name, 0, False)
+    results = shared_memory.SharedMemory(create=True, size=8 * len(starts))
+    try:
+        children = []
+        for i, (start, end) in enumerate(zip(starts, ends)):
+            process = ctx.Process(target=compute_sum_of_squares_shm,
+                                  args=(source, numbers.dtype.str, start, end, results.name, i))
+            process.start()
+            children.append(process)
+        for process in children:
+            process.join()
+        sums = np.ndarray((len(starts),), dtype=np.float64, buffer=results.buf).tolist()
+        return sums, [process.exitcode for process in children]
+    finally:
+        results.close()
+        results.unlink()
+        if segment is not None:
+            segment.close()
+            segment.unlink()
+
+
+def main(file_name, num_children, ipc_method, element_type):
+    if ipc_method not in ('pipe', 'shm'):
+        print("Invalid IPC method. Please use 'shm' for shared memory or 'pipe' for pipes.")
+        return 1
+    try:
+        numbers, data_offset = read_numbers(file_name, element_type)
     except FileNotFoundError:
         print("Unable to open the file")
-        return
-    except ValueError:
-        print("The file must contain real numbers.")
-        return
+        return 1
+    except BinaryFormatError as error:
+        print(f"Invalid binary input: {error}.")
+        return 1
 
     if len(numbers) < 2:
         print("The file must contain at least 2 numbers.")
-        return
+        return 1
 
     M = len(numbers)
-    N = num_threads
+    N = num_children
+    if N > M // 2:
+        N = M // 2
+        print(f"Warning: Number of child processes adjusted to {N} to match input size constraints.")
     sizes = [M // N] * N
     for i in range(M % N):
         sizes[i] += 1
@@ -30,40 +138,32 @@ def main(file_name, num_threads, ipc_method):
     starts = [sum(sizes[:i]) for i in range(N)]
     ends = [start + size for start, size in zip(starts, sizes)]
 
-    threads = []
-    results_queue = queue.Queue()
+    # Children are real processes, so every segment gets its own core; flush
+    # first so forked children do not repeat buffered output.
+    sys.stdout.flush()
+    ctx = multiprocessing.get_context()
     if ipc_method == 'pipe':
-        for i in range(N):
-            data_segment = numbers[starts[i]:ends[i]]
-            thread = threading.Thread(target=compute_sum_of_squares_pipe, args=(data_segment, results_queue))
-            threads.append(thread)
-            thread.start()
-
-        total_sum = sum(results_queue.get() for _ in range(N))
-    elif ipc_method == 'shm':
-        global_sum = [0]
-        lock = Lock()
-        for i in range(N):
-            data_segment = numbers[starts[i]:ends[i]]
-            thread = threading.Thread(target=compute_sum_of_squares_shm, args=(data_segment, global_sum, lock))
-            threads.append(thread)
-            thread.start()
-
-        for thread in threads:
-            thread.join()
-        total_sum = global_sum[0]
+        sums, exit_codes = run_pipe(ctx, numbers, starts, ends)
     else:
-        print("Invalid IPC method. Please use 'shm' for shared memory or 'pipe' for pipes.")
-        return
+        sums, exit_codes = run_shm(ctx, file_name, numbers, data_offset, starts, ends)
+    if any(code != 0 for code in exit_codes):
+        print("A child process failed.")
+        return 1
 
-    print(f"Total sum of squares: {total_sum}")
+    print(f"Total sum of squares: {sum(sums):.6f}")
+    return 0
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 4:
-        print("Incorrect usage. Expected format: python parent_process.py <filename> <number_of_children> <ipc_method>")
+    args = [arg for arg in sys.argv[1:] if not arg.startswith('--element=')]
+    elements = [arg.split('=', 1)[1] for arg in sys.argv[1:] if arg.startswith('--element=')]
+    if len(args) != 3 or any(element not in ('float32', 'float64') for element in elements):
+        print("Incorrect usage. Expected format: python parent_process.py <filename> <number_of_children> <ipc_method> [--element=float32|float64]")
+        sys.exit(1)
+    filename = args[0]
+    n_children = int(args[1]) if args[1].isdigit() else 0
+    if n_children <= 0:
+        print("Error: The number of children must be a positive integer.")
         sys.exit(1)
-    filename = sys.argv[1]
-    n_threads = int(sys.argv[2])
-    ipc = sys.argv[3]
-    main(filename, n_threads, ipc)
+    ipc = args[2]
+    sys.exit(main(filename, n_children, ipc, elements[-1] if elements else 'float32'))
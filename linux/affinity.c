@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define MAX_NODES 64
+
+typedef enum {
+    AFFINITY_NONE,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_PER_NODE
+} AffinityPolicy;
+
+/*
+ * Allowed CPUs grouped by NUMA node. cpus[] is sorted by node, then CPU
+ * number; nodeStart[n]..nodeStart[n]+nodeCount[n] is node n's slice.
+ */
+static AffinityPolicy policy = AFFINITY_NONE;
+static int nCpus;
+static int cpus[CPU_SETSIZE];
+static int nNodes;
+static int nodeIds[MAX_NODES];
+static int nodeStart[MAX_NODES];
+static int nodeCount[MAX_NODES];
+
+static int parseCpuList(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            return -1;
+        }
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int readNodeCpus(int node, cpu_set_t *set) {
+    char path[64], list[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int ok = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    return ok ? parseCpuList(list, set) : -1;
+}
+
+static int compareInts(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+static void loadTopology(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    int nodes[MAX_NODES];
+    int found = 0;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && found < MAX_NODES) {
+            int node;
+            char tail;
+            if (sscanf(entry->d_name, "node%d%c", &node, &tail) == 1) {
+                nodes[found++] = node;
+            }
+        }
+        closedir(dir);
+    }
+    qsort(nodes, found, sizeof(int), compareInts);
+
+    nCpus = 0;
+    nNodes = 0;
+    for (int n = 0; n < found; n++) {
+        cpu_set_t nodeCpus;
+        if (readNodeCpus(nodes[n], &nodeCpus) != 0) {
+            continue;
+        }
+        int start = nCpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &nodeCpus) && CPU_ISSET(cpu, &allowed)) {
+                cpus[nCpus++] = cpu;
+                CPU_CLR(cpu, &allowed);
+            }
+        }
+        if (nCpus > start) {
+            nodeIds[nNodes] = nodes[n];
+            nodeStart[nNodes] = start;
+            nodeCount[nNodes] = nCpus - start;
+            nNodes++;
+        }
+    }
+
+    if (nNodes == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus[nCpus++] = cpu;
+            }
+        }
+        nodeIds[0] = 0;
+        nodeStart[0] = 0;
+        nodeCount[0] = nCpus;
+        nNodes = 1;
+    }
+}
+
+int setAffinityPolicy(const char *name) {
+    if (strcmp(name, "none") == 0) {
+        policy = AFFINITY_NONE;
+        return 0;
+    } else if (strcmp(name, "compact") == 0) {
+        policy = AFFINITY_COMPACT;
+    } else if (strcmp(name, "scatter") == 0) {
+        policy = AFFINITY_SCATTER;
+    } else if (strcmp(name, "per-node") == 0) {
+        policy = AFFINITY_PER_NODE;
+    } else {
+        return -1;
+    }
+    loadTopology();
+    return 0;
+}
+
+int affinityEnabled(void) {
+    return policy != AFFINITY_NONE && nCpus > 0;
+}
+
+static int workerNodeSlot(int index, int nWorkers) {
+    switch (policy) {
+    case AFFINITY_COMPACT:
+        for (int n = 0; n < nNodes; n++) {
+            int k = index % nCpus;
+            if (k >= nodeStart[n] && k < nodeStart[n] + nodeCount[n]) {
+                return n;
+            }
+        }
+        return 0;
+    case AFFINITY_SCATTER:
+        return index % nNodes;
+    case AFFINITY_PER_NODE:
+        return (int)((long long)index * nNodes / nWorkers);
+    default:
+        return 0;
+    }
+}
+
+static int workerCpuSet(int index, int nWorkers, cpu_set_t *set) {
+    if (!affinityEnabled()) {
+        return -1;
+    }
+    CPU_ZERO(set);
+    int slot = workerNodeSlot(index, nWorkers);
+    switch (policy) {
+    case AFFINITY_COMPACT:
+        CPU_SET(cpus[index % nCpus], set);
+        break;
+    case AFFINITY_SCATTER:
+        CPU_SET(cpus[nodeStart[slot] + (index / nNodes) % nodeCount[slot]], set);
+        break;
+    default:
+        for (int k = 0; k < nodeCount[slot]; k++) {
+            CPU_SET(cpus[nodeStart[slot] + k], set);
+        }
+        break;
+    }
+    return 0;
+}
+
+void pinWorker(int index, int nWorkers) {
+    cpu_set_t set;
+    if (workerCpuSet(index, nWorkers, &set) == 0 && sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity failed");
+    }
+}
+
+/* Spreads the pages fully inside the range round-robin over the nodes that
+ * nWorkers pinned workers run on, or prefers the node when there is only
+ * one. Workers claim blocks at run time, so no page has a known reader;
+ * interleaving gives each node its share of the pages and of the memory
+ * bandwidth, instead of all of them landing where the parent first writes
+ * them. */
+void interleaveOverWorkers(void *address, size_t length, int nWorkers) {
+    if (!affinityEnabled()) {
+        return;
+    }
+    unsigned long mask = 0;
+    int nodes = 0;
+    for (int i = 0; i < nWorkers; i++) {
+        int node = nodeIds[workerNodeSlot(i, nWorkers)];
+        if (node < (int)(sizeof(mask) * 8) && !(mask & 1UL << node)) {
+            mask |= 1UL << node;
+            nodes++;
+        }
+    }
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)address + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)address + length) & ~(pageSize - 1);
+    if (nodes == 0 || end <= start) {
+        return;
+    }
+    syscall(SYS_mbind, (void *)start, end - start, nodes > 1 ? MPOL_INTERLEAVE : MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+}
@@ -0,0 +1,11 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+
+int setAffinityPolicy(const char *name);
+int affinityEnabled(void);
+void pinWorker(int index, int nWorkers);
+void interleaveOverWorkers(void *address, size_t length, int nWorkers);
+
+#endif
@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include "async_reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "instrument.h"
+
+#define READ_CHUNK_BYTES (1 << 20)
+#define READ_QUEUE_DEPTH 32
+
+static const char *readerNames[] = { "mmap", "io_uring", "pread" };
+
+static int reader = READER_MMAP;
+static int usedReader = READER_MMAP;
+static int directReads = 0;
+static uint64_t bytesRead;
+static uint64_t readNs;
+static uint64_t progressNs;
+
+/* The three rings io_uring_setup shares with the kernel, mapped by hand so
+ * the build does not depend on liburing. One ring is set up on first use
+ * and kept for every later read. */
+typedef struct {
+    int fd;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned pending;
+} Ring;
+
+static Ring ring;
+static int ringReady;
+
+/* Bytes begin..end of buffer, which holds the file from offset onwards,
+ * split into READ_CHUNK_BYTES chunks. done counts the bytes of each chunk
+ * read so far and prefix the chunks complete in order. */
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t offset;
+    size_t length;
+    size_t begin;
+    size_t end;
+    size_t *done;
+    size_t nChunks;
+    size_t prefix;
+    ReadProgress progress;
+    void *arg;
+} ReadPass;
+
+int setInputReader(const char *name) {
+    for (int i = 0; i < (int)(sizeof(readerNames) / sizeof(readerNames[0])); i++) {
+        if (strcmp(name, readerNames[i]) == 0 || (i == READER_URING && strcmp(name, "uring") == 0)) {
+            reader = i;
+            usedReader = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int inputReader(void) {
+    return reader;
+}
+
+void setDirectReads(int enabled) {
+    directReads = enabled;
+}
+
+const char *readerName(void) {
+    return readerNames[usedReader];
+}
+
+uint64_t readerBytes(void) {
+    return bytesRead;
+}
+
+double readerSeconds(void) {
+    return (double)readNs / 1e9;
+}
+
+static void ringDestroy(Ring *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    close(ring->fd);
+}
+
+static int ringSetup(Ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cqRingSize > ring->sqRingSize) {
+        ring->sqRingSize = ring->cqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = single ? ring->sqRing
+        : mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int saved = errno;
+        ringDestroy(ring);
+        errno = saved;
+        return -1;
+    }
+
+    char *sq = ring->sqRing;
+    char *cq = ring->cqRing;
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ringQueueRead(Ring *ring, int fd, void *buffer, size_t length, size_t offset, uint64_t userData) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = (uint32_t)length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+}
+
+/* Submits whatever is queued and waits for at least one completion. */
+static int ringSubmitAndWait(Ring *ring) {
+    for (;;) {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted >= 0) {
+            ring->pending -= (unsigned)submitted;
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static size_t chunkStart(const ReadPass *pass, size_t i) {
+    return pass->begin + i * READ_CHUNK_BYTES;
+}
+
+static size_t chunkLength(const ReadPass *pass, size_t i) {
+    size_t start = chunkStart(pass, i);
+    return pass->end - start < READ_CHUNK_BYTES ? pass->end - start : READ_CHUNK_BYTES;
+}
+
+static void advancePrefix(ReadPass *pass) {
+    size_t before = pass->prefix;
+    while (pass->prefix < pass->nChunks && pass->done[pass->prefix] == chunkLength(pass, pass->prefix)) {
+        pass->prefix++;
+    }
+    if (pass->progress != NULL && pass->prefix != before) {
+        size_t ready = pass->prefix == pass->nChunks ? pass->end : chunkStart(pass, pass->prefix);
+        uint64_t start = monotonicNs();
+        pass->progress(pass->arg, pass->buffer, pass->length, ready);
+        progressNs += monotonicNs() - start;
+    }
+}
+
+static void queueChunk(Ring *ring, ReadPass *pass, size_t i) {
+    size_t at = chunkStart(pass, i) + pass->done[i];
+    ringQueueRead(ring, pass->fd, pass->buffer + at, chunkLength(pass, i) - pass->done[i], pass->offset + at, i);
+}
+
+/* Keeps up to READ_QUEUE_DEPTH chunk reads in flight, requeueing the rest
+ * of a chunk after a short read. Returns 1 when io_uring is unavailable. */
+static int readWithRing(ReadPass *pass) {
+    if (!ringReady) {
+        if (ringSetup(&ring, READ_QUEUE_DEPTH) != 0) {
+            return 1;
+        }
+        ringReady = 1;
+    }
+
+    size_t next = 0, complete = 0;
+    unsigned inFlight = 0;
+    int failed = 0;
+    while (inFlight > 0 || (!failed && complete < pass->nChunks)) {
+        while (!failed && inFlight < READ_QUEUE_DEPTH && next < pass->nChunks) {
+            queueChunk(&ring, pass, next++);
+            inFlight++;
+        }
+        if (ringSubmitAndWait(&ring) != 0) {
+            failed = errno;
+            break;
+        }
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+            size_t i = (size_t)cqe->user_data;
+            inFlight--;
+            if (cqe->res <= 0) {
+                failed = cqe->res < 0 ? -cqe->res : ENODATA;
+                continue;
+            }
+            pass->done[i] += (size_t)cqe->res;
+            if (pass->done[i] < chunkLength(pass, i)) {
+                if (!failed) {
+                    queueChunk(&ring, pass, i);
+                    inFlight++;
+                }
+            } else {
+                complete++;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+        advancePrefix(pass);
+    }
+
+    if (inFlight > 0) {
+        ringDestroy(&ring);
+        ringReady = 0;
+    }
+    if (failed) {
+        errno = failed;
+        return -1;
+    }
+    return 0;
+}
+
+static int readWithPread(ReadPass *pass) {
+    for (size_t i = 0; i < pass->nChunks; i++) {
+        while (pass->done[i] < chunkLength(pass, i)) {
+            size_t at = chunkStart(pass, i) + pass->done[i];
+            ssize_t n = pread(pass->fd, pass->buffer + at, chunkLength(pass, i) - pass->done[i], (off_t)(pass->offset + at));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n == 0) {
+                    errno = ENODATA;
+                }
+                return -1;
+            }
+            pass->done[i] += (size_t)n;
+        }
+        advancePrefix(pass);
+    }
+    return 0;
+}
+
+static int runPass(ReadPass *pass) {
+    pass->nChunks = (pass->end - pass->begin + READ_CHUNK_BYTES - 1) / READ_CHUNK_BYTES;
+    pass->prefix = 0;
+    pass->done = calloc(pass->nChunks > 0 ? pass->nChunks : 1, sizeof(size_t));
+    if (pass->done == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int rc = 1;
+    if (usedReader == READER_URING) {
+        rc = readWithRing(pass);
+        if (rc == 1) {
+            perror("Warning: io_uring is unavailable, falling back to pread");
+            usedReader = READER_PREAD;
+        }
+    }
+    if (rc == 1) {
+        rc = readWithPread(pass);
+    }
+    free(pass->done);
+    return rc;
+}
+
+/* Opens with O_DIRECT when --direct was given and the file system takes
+ * it, otherwise for buffered sequential reads. */
+int openForReading(const char *path) {
+    int fd = open(path, O_RDONLY | (directReads ? O_DIRECT : 0));
+    if (fd == -1 && directReads && errno == EINVAL) {
+        fprintf(stderr, "Warning: %s does not support O_DIRECT, using buffered reads.\n", path);
+        fd = open(path, O_RDONLY);
+    }
+    if (fd != -1 && !directReads) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return fd;
+}
+
+/*
+ * Reads length bytes at offset into buffer through the selected reader.
+ * Time spent in progress is left out of readerSeconds, which then covers
+ * only waiting for the reads that parsing did not hide.
+ * On an O_DIRECT fd the aligned part is read directly and the unaligned
+ * tail, or everything when offset or buffer is unaligned, through the page
+ * cache, so callers need no padding.
+ */
+int readFileInto(int fd, size_t offset, size_t length, void *buffer, ReadProgress progress, void *arg) {
+    uint64_t start = monotonicNs();
+    uint64_t progressBefore = progressNs;
+    int flags = fcntl(fd, F_GETFL);
+    int direct = flags != -1 && (flags & O_DIRECT) != 0;
+    size_t directEnd = 0;
+    if (direct && (offset | (uintptr_t)buffer) % DIRECT_ALIGNMENT == 0) {
+        directEnd = length - length % DIRECT_ALIGNMENT;
+    }
+
+    ReadPass pass = { fd, buffer, offset, length, 0, directEnd, NULL, 0, 0, progress, arg };
+    int rc = directEnd > 0 ? runPass(&pass) : 0;
+    if (rc == 0 && directEnd < length) {
+        if (direct) {
+            fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        pass.begin = directEnd;
+        pass.end = length;
+        rc = runPass(&pass);
+        if (direct) {
+            int saved = errno;
+            fcntl(fd, F_SETFL, flags);
+            errno = saved;
+        }
+    }
+    bytesRead += length;
+    readNs += monotonicNs() - start - (progressNs - progressBefore);
+    return rc;
+}
+
+/* Like openInputFile, but reads the whole file into an aligned buffer that
+ * closeInputFile frees. Anything but a regular file goes through
+ * openInputFile. */
+int readInputFile(const char *path, InputFile *input, ReadProgress progress, void *arg) {
+    if (strcmp(path, "-") == 0) {
+        return openInputFile(path, input);
+    }
+    int fd = openForReading(path);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return openInputFile(path, input);
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *buffer;
+    if (posix_memalign(&buffer, DIRECT_ALIGNMENT, size > 0 ? size : 1) != 0) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (readFileInto(fd, 0, size, buffer, progress, arg) != 0) {
+        int saved = errno;
+        free(buffer);
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    close(fd);
+    input->data = buffer;
+    input->size = size;
+    input->isMapped = 0;
+    return 0;
+}
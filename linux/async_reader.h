@@ -0,0 +1,34 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "number_parser.h"
+
+/* File offset, buffer and length alignment that O_DIRECT reads need. */
+#define DIRECT_ALIGNMENT 4096
+
+enum {
+    READER_MMAP,
+    READER_URING,
+    READER_PREAD
+};
+
+/* Called whenever the prefix of the destination that has been read grows;
+ * ready is in bytes from the start of data. */
+typedef void (*ReadProgress)(void *arg, const char *data, size_t size, size_t ready);
+
+int setInputReader(const char *name);
+int inputReader(void);
+void setDirectReads(int enabled);
+
+int openForReading(const char *path);
+int readFileInto(int fd, size_t offset, size_t length, void *buffer, ReadProgress progress, void *arg);
+int readInputFile(const char *path, InputFile *input, ReadProgress progress, void *arg);
+
+const char *readerName(void);
+uint64_t readerBytes(void);
+double readerSeconds(void);
+
+#endif
@@ -0,0 +1,114 @@
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glob.h>
+
+static int addPath(BatchList *list, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        char **grown = realloc(list->paths, capacity * sizeof(char *));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        list->paths = grown;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+/* One path per line; blank lines and lines starting with '#' are skipped,
+ * and "-" reads the list from standard input. */
+static int addManifest(BatchList *list, const char *manifest) {
+    FILE *file = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open the manifest %s: %s\n", manifest, strerror(errno));
+        return -1;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    int status = 0;
+    while (status == 0 && (length = getline(&line, &size, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0 && line[0] != '#') {
+            status = addPath(list, line);
+        }
+    }
+    free(line);
+    if (file != stdin) {
+        fclose(file);
+    }
+    return status;
+}
+
+static int addGlob(BatchList *list, const char *pattern) {
+    glob_t matches;
+    int rc = glob(pattern, 0, NULL, &matches);
+    if (rc == GLOB_NOMATCH) {
+        fprintf(stderr, "No files match %s\n", pattern);
+        return -1;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Unable to expand %s\n", pattern);
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < matches.gl_pathc; i++) {
+        status = addPath(list, matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+    return status;
+}
+
+/*
+ * Expands the inputs of a --batch run: "@<manifest>" names a file listing
+ * one path per line, an argument with glob characters is expanded in
+ * sorted order (quote it to keep the shell from doing so), and anything
+ * else is a path. Returns -1 after printing an error.
+ */
+int collectBatchInputs(char *const *args, int nArgs, BatchList *list) {
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    for (int i = 0; i < nArgs; i++) {
+        int status;
+        if (args[i][0] == '@') {
+            status = addManifest(list, args[i] + 1);
+        } else if (strpbrk(args[i], "*?[") != NULL) {
+            status = addGlob(list, args[i]);
+        } else {
+            status = addPath(list, args[i]);
+        }
+        if (status != 0) {
+            freeBatchList(list);
+            return -1;
+        }
+    }
+    if (list->count == 0) {
+        fprintf(stderr, "The batch has no input files.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void freeBatchList(BatchList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
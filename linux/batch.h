@@ -0,0 +1,16 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/* Input files of a --batch run, in command line order. */
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} BatchList;
+
+int collectBatchInputs(char *const *args, int nArgs, BatchList *list);
+void freeBatchList(BatchList *list);
+
+#endif
@@ -0,0 +1,171 @@
+#!/bin/bash
+
+# Runs every backend over synthetic datasets and a sweep of worker counts,
+# one CSV or JSON row per run, from the --timings line of parent_process.
+#
+#   ./bench.sh [--sizes "64K 16M 1G"] [--children "1 2 4 8"] [--methods "shm pipe thread stream parallel-parse"]
+#              [--inputs "text binary"] [--element float32|float64] [--readers "mmap uring pread"] [--direct]
+#              [--repeat N] [--format csv|json] [--data-dir DIR] [--output FILE]
+#
+# Datasets are generated once per size in the data directory and reused.
+# Text sizes are in bytes; the binary file holds the same numbers. Readers
+# other than mmap also report the read rate, which stream and
+# parallel-parse do not support.
+
+set -u
+cd "$(dirname "$0")"
+
+sizes="64K 1M 16M 256M"
+children="1 2 4 8"
+methods="shm pipe thread stream parallel-parse"
+inputs="text binary"
+element=float32
+readers=mmap
+direct=""
+repeat=3
+format=csv
+dataDir=bench-data
+output=/dev/stdout
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+    --sizes) sizes="$2"; shift ;;
+    --children) children="$2"; shift ;;
+    --methods) methods="$2"; shift ;;
+    --inputs) inputs="$2"; shift ;;
+    --element) element="$2"; shift ;;
+    --readers) readers="$2"; shift ;;
+    --direct) direct=--direct ;;
+    --repeat) repeat="$2"; shift ;;
+    --format) format="$2"; shift ;;
+    --data-dir) dataDir="$2"; shift ;;
+    --output) output="$2"; shift ;;
+    *) sed -n '3,12p' "$0" >&2; exit 1 ;;
+    esac
+    shift
+done
+
+if [ "$format" != csv ] && [ "$format" != json ]; then
+    echo "Invalid format '$format'. Please use 'csv' or 'json'." >&2
+    exit 1
+fi
+
+bash build.sh || exit 1
+mkdir -p "$dataDir" || exit 1
+
+convertFlag=""
+if [ "$element" = float64 ]; then
+    convertFlag=--float64
+fi
+
+columns="size,input,element,reader,method,children,run,elements,bytes,wall_s,parse_s,transfer_s,spawn_s,compute_s,collect_s,gb_per_s,read_s,read_gb_per_s,rss_kb,child_rss_kb,status"
+rows=()
+
+# Runs one configuration and appends its row. Stream and parallel-parse
+# overlap reading with compute, so their parse time is reported as compute.
+runOne() {
+    local size=$1 input=$2 reader=$3 method=$4 n=$5 run=$6 file=$7
+    local args=("$file" "$n")
+    case "$method" in
+    stream) args+=(shm --stream) ;;
+    parallel-parse) args+=(shm --parallel-parse) ;;
+    *) args+=("$method") ;;
+    esac
+    if [ "$input" = text ]; then
+        args+=(--element="$element")
+    fi
+    if [ "$reader" != mmap ]; then
+        args+=(--reader="$reader" $direct)
+    fi
+
+    local timings
+    timings=$(./parent_process "${args[@]}" --timings 2>&1 >/dev/null | grep '^Timings:')
+    if [ -z "$timings" ]; then
+        rows+=("$size,$input,$element,$reader,$method,$n,$run,,,,,,,,,,,,,,failed")
+        return
+    fi
+    local wall parse transfer spawn compute collect elements bytes rss childRss readTime readBytes
+    for field in $timings; do
+        case "$field" in
+        wall=*) wall=${field#*=} ;;
+        parse=*) parse=${field#*=} ;;
+        transfer=*) transfer=${field#*=} ;;
+        spawn=*) spawn=${field#*=} ;;
+        compute=*) compute=${field#*=} ;;
+        collect=*) collect=${field#*=} ;;
+        elements=*) elements=${field#*=} ;;
+        bytes=*) bytes=${field#*=} ;;
+        rss_kb=*) rss=${field#*=} ;;
+        child_rss_kb=*) childRss=${field#*=} ;;
+        read_s=*) readTime=${field#*=} ;;
+        read_bytes=*) readBytes=${field#*=} ;;
+        esac
+    done
+    local rate readRate=""
+    rate=$(awk -v b="$bytes" -v s="$wall" 'BEGIN { printf "%.3f", (s > 0 ? b / s / 1e9 : 0) }')
+    if [ "$reader" = mmap ]; then
+        readTime=""
+    else
+        readRate=$(awk -v b="$readBytes" -v s="$readTime" 'BEGIN { printf "%.3f", (s > 0 ? b / s / 1e9 : 0) }')
+    fi
+    rows+=("$size,$input,$element,$reader,$method,$n,$run,$elements,$bytes,$wall,$parse,$transfer,$spawn,$compute,$collect,$rate,$readTime,$readRate,$rss,$childRss,ok")
+}
+
+for size in $sizes; do
+    text="$dataDir/numbers-$size.txt"
+    binary="$dataDir/numbers-$size-$element.bin"
+    if [ ! -s "$text" ]; then
+        ./generate_numbers "$size" "$text" >&2 || exit 1
+    fi
+    if [[ " $inputs " == *" binary "* ]] && [ ! -s "$binary" ]; then
+        ./convert_numbers $convertFlag "$text" "$binary" >&2 || exit 1
+    fi
+
+    for input in $inputs; do
+        file=$text
+        if [ "$input" = binary ]; then
+            file=$binary
+        fi
+        for reader in $readers; do
+            for method in $methods; do
+                if [ "$method" = parallel-parse ] && [ "$input" = binary ]; then
+                    continue
+                fi
+                if [ "$reader" != mmap ] && { [ "$method" = stream ] || [ "$method" = parallel-parse ]; }; then
+                    continue
+                fi
+                for n in $children; do
+                    for run in $(seq 1 "$repeat"); do
+                        echo "size=$size input=$input reader=$reader method=$method children=$n run=$run" >&2
+                        runOne "$size" "$input" "$reader" "$method" "$n" "$run" "$file"
+                    done
+                done
+            done
+        done
+    done
+done
+
+{
+    if [ "$format" = csv ]; then
+        echo "$columns"
+        printf '%s\n' "${rows[@]}"
+    else
+        printf '%s\n' "${rows[@]}" | awk -v columns="$columns" '
+            BEGIN { n = split(columns, names, ","); printf "[" }
+            {
+                split($0, values, ",")
+                printf "%s\n  {", (NR > 1 ? "," : "")
+                for (i = 1; i <= n; i++) {
+                    value = values[i]
+                    if (value == "") {
+                        value = "null"
+                    } else if (value !~ /^-?[0-9]+(\.[0-9]+)?$/ || names[i] == "size") {
+                        value = "\"" value "\""
+                    }
+                    printf "%s\"%s\": %s", (i > 1 ? ", " : ""), names[i], value
+                }
+                printf "}"
+            }
+            END { print "\n]" }'
+    fi
+} > "$output"
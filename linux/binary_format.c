@@ -0,0 +1,97 @@
+#include "binary_format.h"
+
+#include <string.h>
+
+static uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+}
+
+static uint16_t swap16(uint16_t v) {
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+static uint64_t swap64(uint64_t v) {
+    return ((uint64_t)swap32((uint32_t)v) << 32) | swap32((uint32_t)(v >> 32));
+}
+
+int isBinaryInput(const char *data, size_t size) {
+    return size >= BINARY_HEADER_SIZE && memcmp(data, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0;
+}
+
+int readBinaryHeader(const char *data, size_t size, BinaryInfo *info, const char **error) {
+    BinaryHeader header;
+    if (!isBinaryInput(data, size)) {
+        *error = "not a binary number file";
+        return -1;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    int swapped = 0;
+    if (header.byteOrder == swap32(BINARY_BYTE_ORDER)) {
+        swapped = 1;
+        header.version = swap16(header.version);
+        header.elementType = swap16(header.elementType);
+        header.count = swap64(header.count);
+        header.dataOffset = swap64(header.dataOffset);
+    } else if (header.byteOrder != BINARY_BYTE_ORDER) {
+        *error = "unknown byte order marker";
+        return -1;
+    }
+
+    if (header.version != BINARY_VERSION) {
+        *error = "unsupported format version";
+        return -1;
+    }
+    if (header.elementType != ELEMENT_FLOAT32 && header.elementType != ELEMENT_FLOAT64) {
+        *error = "unsupported element type";
+        return -1;
+    }
+    size_t width = elementSize(header.elementType);
+    if (header.dataOffset < BINARY_HEADER_SIZE || header.dataOffset % width != 0
+        || header.dataOffset > size || header.count > (size - header.dataOffset) / width) {
+        *error = "header does not match the file size";
+        return -1;
+    }
+
+    info->count = (size_t)header.count;
+    info->dataOffset = (size_t)header.dataOffset;
+    info->elementType = header.elementType;
+    info->swapped = swapped;
+    return 0;
+}
+
+void initBinaryHeader(BinaryHeader *header, size_t count, int elementType) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, BINARY_MAGIC, BINARY_MAGIC_SIZE);
+    header->byteOrder = BINARY_BYTE_ORDER;
+    header->version = BINARY_VERSION;
+    header->elementType = (uint16_t)elementType;
+    header->count = count;
+    header->dataOffset = BINARY_HEADER_SIZE;
+}
+
+void swapFloats(float *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &src[i], sizeof(bits));
+        bits = swap32(bits);
+        memcpy(&dst[i], &bits, sizeof(bits));
+    }
+}
+
+void swapDoubles(double *dst, const double *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t bits;
+        memcpy(&bits, &src[i], sizeof(bits));
+        bits = swap64(bits);
+        memcpy(&dst[i], &bits, sizeof(bits));
+    }
+}
+
+void swapElements(void *dst, const void *src, size_t count, int elementType) {
+    if (elementType == ELEMENT_FLOAT64) {
+        swapDoubles(dst, src, count);
+    } else {
+        swapFloats(dst, src, count);
+    }
+}
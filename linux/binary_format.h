@@ -0,0 +1,39 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "element_type.h"
+
+#define BINARY_MAGIC "SPNUMBIN"
+#define BINARY_MAGIC_SIZE 8
+#define BINARY_VERSION 1
+#define BINARY_BYTE_ORDER 0x01020304u
+#define BINARY_HEADER_SIZE 64
+
+typedef struct {
+    char magic[BINARY_MAGIC_SIZE];
+    uint32_t byteOrder;
+    uint16_t version;
+    uint16_t elementType;
+    uint64_t count;
+    uint64_t dataOffset;
+    uint8_t reserved[BINARY_HEADER_SIZE - 32];
+} BinaryHeader;
+
+typedef struct {
+    size_t count;
+    size_t dataOffset;
+    int elementType;
+    int swapped;
+} BinaryInfo;
+
+int isBinaryInput(const char *data, size_t size);
+int readBinaryHeader(const char *data, size_t size, BinaryInfo *info, const char **error);
+void initBinaryHeader(BinaryHeader *header, size_t count, int elementType);
+void swapFloats(float *dst, const float *src, size_t count);
+void swapDoubles(double *dst, const double *src, size_t count);
+void swapElements(void *dst, const void *src, size_t count, int elementType);
+
+#endif
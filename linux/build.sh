@@ -1,4 +1,6 @@
 #!/bin/bash
 
-gcc -o child_process child_process.c -lrt
-gcc -o parent_process parent_process.c -lrt
\ No newline at end of file
+gcc -O2 -o child_process child_process.c completion.c instrument.c number_parser.c pipe_protocol.c reduction.c sum_kernel.c -lm -lrt
+gcc -O2 -pthread -o parent_process parent_process.c affinity.c async_reader.c batch.c binary_format.c completion.c distributed.c incremental.c instrument.c number_parser.c pipe_protocol.c reduction.c shared_segment.c stream.c sum_kernel.c worker_pool.c -lm -lrt
+gcc -O2 -o convert_numbers convert_numbers.c number_parser.c binary_format.c
+gcc -O2 -o generate_numbers generate_numbers.c binary_format.c
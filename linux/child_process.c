@@ -3,71 +3,359 @@
 #include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
-#include <semaphore.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <string.h>
 
-float calculateSumOfSquares(float *numbers, int startIdx, int endIdx);
+#include "common.h"
+#include "completion.h"
+#include "number_parser.h"
+#include "pipe_protocol.h"
+#include "reduction.h"
+#include "work_queue.h"
+
+#define PARSE_BLOCK_SIZE 4096
+
+typedef struct {
+    void *base;
+    size_t length;
+    int isSysV;
+} InputRegion;
+
+void parseOps(const char *text, const char *elementName, ReductionSpec *spec);
+const char *attachInput(const char *spec, size_t length, InputRegion *region);
+void *attachResults(const char *spec, InputRegion *region);
+void detachInput(InputRegion *region);
+int serveFrames(const ReductionSpec *spec);
 
 int main(int argc, char *argv[]) {
     if (strcmp(argv[1], "shm") == 0) {
-        int shmID = atoi(argv[2]);
-        int shmIDResult = atoi(argv[3]);
+        const char *inputSpec = argv[2];
+        const char *resultSpec = argv[3];
         int childIndex = atoi(argv[4]);
         int nChildren = atoi(argv[5]);
-        int count = atoi(argv[6]);
+        size_t count = strtoull(argv[6], NULL, 10);
+        ReductionSpec spec;
+        parseOps(argv[7], argv[8], &spec);
+        size_t width = elementSize(spec.elementType);
 
-        float *numbers = (float *)shmat(shmID, NULL, SHM_RDONLY);
-        float *resultPtr = (float *)shmat(shmIDResult, NULL, 0);
-        if (numbers == (void *)-1 || resultPtr == (void *)-1) {
-            fprintf(stderr, "shmat failed\n");
+        InputRegion region, resultRegion;
+        const char *numbers = attachInput(inputSpec, count * width, &region);
+        ResultSegment *resultSegment = attachResults(resultSpec, &resultRegion);
+        if (numbers == NULL || resultSegment == NULL) {
+            fprintf(stderr, "Unable to attach the shared segments\n");
             exit(EXIT_FAILURE);
         }
 
-        sem_t *sem = sem_open("/semaphore", 0);
-        if (sem == SEM_FAILED) {
-            perror("sem_open failed");
-            exit(EXIT_FAILURE);
+        /* The work queue follows the result slots in the same segment. A
+         * backup child is also given the block to redo before it claims
+         * any of its own. */
+        WorkQueue *queue = (WorkQueue *)&resultSegment->slots[nChildren];
+        WorkerProgress *progress = &resultSegment->slots[childIndex].progress;
+        size_t block = 0, startIdx = 0, endIdx = 0;
+        int redo = argc > 9;
+        if (redo) {
+            block = strtoull(argv[9], NULL, 10);
+            blockRange(queue, block, &startIdx, &endIdx);
         }
+        ReductionState own;
+        reductionInit(&own);
+        WorkerStats stats;
+        workerStatsBegin(&stats);
+        for (;;) {
+            uint64_t claimedNs = monotonicNs();
+            atomic_store_explicit(&progress->claimedNs, claimedNs, memory_order_relaxed);
+            if (redo) {
+                atomic_store_explicit(&progress->block, block + 1, memory_order_release);
+                redo = 0;
+            } else if (!claimOwnedBlock(queue, &progress->block, &block, &startIdx, &endIdx)) {
+                break;
+            }
 
-        int segmentSize = count / nChildren;
-        int remainder = count % nChildren;
-        int startIdx = childIndex * segmentSize + (childIndex < remainder ? childIndex : remainder);
-        int endIdx = startIdx + segmentSize + (childIndex < remainder ? 1 : 0);
+            ReductionState partial;
+            reduceRange(&spec, numbers + startIdx * width, endIdx - startIdx, &partial);
+            if (finishBlock(queue, block, &partial)) {
+                reductionMerge(&own, &partial);
+                completionArrive(&resultSegment->completion);
+            }
+            stats.bytes += (endIdx - startIdx) * width;
+            stats.units++;
 
-        float sum = calculateSumOfSquares(numbers, startIdx, endIdx);
+            atomic_store_explicit(&progress->block, 0, memory_order_relaxed);
+            atomic_fetch_add_explicit(&progress->busyNs, monotonicNs() - claimedNs, memory_order_relaxed);
+            atomic_fetch_add_explicit(&progress->blocks, 1, memory_order_release);
+        }
+        workerStatsFinish(&stats, 0);
 
-        sem_wait(sem);
-        resultPtr[childIndex] = sum;
-        sem_post(sem);
+        publishResult(&resultSegment->slots[childIndex], &own, &stats, 1);
 
-        shmdt(numbers);
-        shmdt(resultPtr);
-        sem_close(sem);
+        detachInput(&region);
+        detachInput(&resultRegion);
 
         //sleep(10); 
         exit(EXIT_SUCCESS);
     } else if (strcmp(argv[1], "pipe") == 0) {
-        float sum = 0;
-        float number;
-        while (read(STDIN_FILENO, &number, sizeof(number)) > 0) {
-            sum += (float)number * (float)number;
+        ReductionSpec spec;
+        parseOps(argv[2], argv[3], &spec);
+        if (serveFrames(&spec) != 0) {
+            exit(EXIT_FAILURE);
         }
 
-        write(STDOUT_FILENO, &sum, sizeof(sum)); 
-
         //sleep(10);
         exit(EXIT_SUCCESS);
+    } else if (strcmp(argv[1], "worker") == 0) {
+        ReductionSpec spec;
+        parseOps(DEFAULT_REDUCTION_OPS, "float32", &spec);
+        exit(serveFrames(&spec) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    } else if (strcmp(argv[1], "text") == 0) {
+        const char *fileName = argv[2];
+        size_t startOffset = strtoull(argv[3], NULL, 10);
+        size_t endOffset = strtoull(argv[4], NULL, 10);
+        const char *resultSpec = argv[5];
+        int childIndex = atoi(argv[6]);
+        ReductionSpec spec;
+        parseOps(argv[7], argv[8], &spec);
+
+        InputRegion resultRegion;
+        ResultSegment *resultSegment = attachResults(resultSpec, &resultRegion);
+        if (resultSegment == NULL) {
+            fprintf(stderr, "Unable to attach the shared segments\n");
+            exit(EXIT_FAILURE);
+        }
+
+        InputFile input;
+        if (openInputFile(fileName, &input) != 0) {
+            perror("Unable to open the file");
+            exit(EXIT_FAILURE);
+        }
+        if (endOffset > input.size) {
+            endOffset = input.size;
+        }
+
+        const char *cursor = input.data + (startOffset < endOffset ? startOffset : endOffset);
+        const char *end = input.data + endOffset;
+        double block[PARSE_BLOCK_SIZE];
+        Reducer reducer;
+        reducerInit(&reducer, &spec);
+        WorkerStats stats;
+        workerStatsBegin(&stats);
+        const char *begin = cursor;
+        for (;;) {
+            size_t parsed = parseElements(cursor, end, block, spec.elementType, PARSE_BLOCK_SIZE, &cursor);
+            reducerUpdate(&reducer, block, parsed);
+            stats.units++;
+            if (parsed < PARSE_BLOCK_SIZE) {
+                break;
+            }
+        }
+        stats.bytes = (uint64_t)(cursor - begin);
+        workerStatsFinish(&stats, 0);
+
+        ReductionState state;
+        reducerFinish(&reducer, &state);
+        publishResult(&resultSegment->slots[childIndex], &state, &stats, cursor == end);
+        completionArrive(&resultSegment->completion);
+
+        closeInputFile(&input);
+        detachInput(&resultRegion);
+        exit(EXIT_SUCCESS);
     } else {
         fprintf(stderr, "Invalid IPC method\n");
         exit(EXIT_FAILURE);
     }
 }
 
-float calculateSumOfSquares(float *numbers, int startIdx, int endIdx) {
-    float sum = 0;
-    for (int i = startIdx; i < endIdx; i++) {
-        sum += (float)numbers[i] * (float)numbers[i];
+void parseOps(const char *text, const char *elementName, ReductionSpec *spec) {
+    int elementType = elementName != NULL ? parseElementType(elementName) : -1;
+    if (text == NULL || elementType == -1 || parseReductionSpec(text, elementType, spec) != 0) {
+        fprintf(stderr, "Invalid reduction list\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Input named by a segment spec: "fd:<n>" for an inherited memfd, which is
+ * mapped read-only and prefaulted, "file:<offset>:<path>" for a binary
+ * file, or a SysV shmID. Segment specs may end in "+<offset>" when the
+ * elements start past a prefix of the segment. */
+const char *attachInput(const char *spec, size_t length, InputRegion *region) {
+    if (strncmp(spec, "file:", 5) != 0) {
+        int isMemfd = strncmp(spec, "fd:", 3) == 0;
+        char *end;
+        int id = (int)strtol(isMemfd ? spec + 3 : spec, &end, 10);
+        size_t offset = *end == '+' ? strtoull(end + 1, NULL, 10) : 0;
+        void *base;
+        if (isMemfd) {
+            base = mmap(NULL, offset + length, PROT_READ, MAP_SHARED | MAP_POPULATE, id, 0);
+            if (base == MAP_FAILED) {
+                perror("mmap failed");
+                return NULL;
+            }
+        } else {
+            base = shmat(id, NULL, SHM_RDONLY);
+            if (base == (void *)-1) {
+                return NULL;
+            }
+        }
+        region->base = base;
+        region->length = offset + length;
+        region->isSysV = !isMemfd;
+        return (const char *)base + offset;
+    }
+
+    char *pathStart;
+    size_t offset = strtoull(spec + 5, &pathStart, 10);
+    if (*pathStart != ':') {
+        return NULL;
+    }
+    int fd = open(pathStart + 1, O_RDONLY);
+    if (fd == -1) {
+        perror("Unable to open the file");
+        return NULL;
+    }
+    length += offset;
+    void *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap failed");
+        return NULL;
+    }
+    region->base = base;
+    region->length = length;
+    region->isSysV = 0;
+    return (const char *)base + offset;
+}
+
+/* The writable result segment, whose memfd size is the segment size. */
+void *attachResults(const char *spec, InputRegion *region) {
+    if (strncmp(spec, "fd:", 3) != 0) {
+        void *base = shmat(atoi(spec), NULL, 0);
+        region->base = base;
+        region->isSysV = 1;
+        return base == (void *)-1 ? NULL : base;
+    }
+    int fd = atoi(spec + 3);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return NULL;
+    }
+    void *base = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    region->base = base;
+    region->length = (size_t)info.st_size;
+    region->isSysV = 0;
+    return base;
+}
+
+void detachInput(InputRegion *region) {
+    if (region->isSysV) {
+        shmdt(region->base);
+    } else {
+        munmap(region->base, region->length);
+    }
+}
+
+/*
+ * Frame loop shared by the "pipe" child and the pooled "worker", run until
+ * the parent closes the input. DATA frames are reduced with spec until END,
+ * one block of input at a time for a pipe child; a JOB frame names a shared
+ * input region, the part of it to reduce and its own reductions. Each END
+ * or JOB is answered by one RESULT carrying a ReductionState and the
+ * worker's stats, whose busy time leaves out waiting for DATA frames.
+ */
+int serveFrames(const ReductionSpec *spec) {
+    static double block[PIPE_FRAME_BYTES / sizeof(double)];
+    char *attachedSpec = NULL;
+    size_t attachedLength = 0;
+    InputRegion region;
+    const char *numbers = NULL;
+
+    Reducer reducer;
+    reducerInit(&reducer, spec);
+    WorkerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    FrameHeader header;
+    int status;
+    while ((status = receiveFrameHeader(STDIN_FILENO, &header)) == 1) {
+        WorkerResult result;
+        if (stats.startNs == 0) {
+            workerStatsBegin(&stats);
+        }
+        if (header.type == FRAME_DATA) {
+            uint64_t remaining = header.length;
+            while (remaining > 0) {
+                size_t chunk = remaining < sizeof(block) ? (size_t)remaining : sizeof(block);
+                if (readAll(STDIN_FILENO, block, chunk) != (ssize_t)chunk) {
+                    fprintf(stderr, "Truncated data frame\n");
+                    return -1;
+                }
+                uint64_t started = monotonicNs();
+                reducerUpdate(&reducer, block, chunk / elementSize(spec->elementType));
+                stats.busyNs += monotonicNs() - started;
+                stats.bytes += chunk;
+                remaining -= chunk;
+            }
+            stats.units++;
+            continue;
+        } else if (header.type == FRAME_END) {
+            reducerFinish(&reducer, &result.state);
+            reducerInit(&reducer, spec);
+        } else if (header.type == FRAME_JOB && header.length > sizeof(WorkerJob) && header.length < sizeof(block)) {
+            char *payload = (char *)block;
+            if (readAll(STDIN_FILENO, payload, header.length) != (ssize_t)header.length) {
+                fprintf(stderr, "Truncated job frame\n");
+                return -1;
+            }
+            payload[header.length] = '\0';
+            WorkerJob job;
+            memcpy(&job, payload, sizeof(job));
+            const char *inputSpec = payload + sizeof(job);
+            size_t width = elementSize(job.spec.elementType);
+            size_t length = (job.offset + job.count) * width;
+
+            if (attachedSpec == NULL || strcmp(attachedSpec, inputSpec) != 0 || length > attachedLength) {
+                if (attachedSpec != NULL) {
+                    detachInput(&region);
+                    free(attachedSpec);
+                    attachedSpec = NULL;
+                }
+                numbers = attachInput(inputSpec, length, &region);
+                if (numbers == NULL) {
+                    fprintf(stderr, "Unable to attach input %s\n", inputSpec);
+                    return -1;
+                }
+                attachedSpec = strdup(inputSpec);
+                attachedLength = length;
+            }
+
+            size_t startIdx, endIdx;
+            segmentBounds(job.count, job.parts, job.part, &startIdx, &endIdx);
+            reduceRange(&job.spec, numbers + (job.offset + startIdx) * width, endIdx - startIdx, &result.state);
+            stats.bytes = (endIdx - startIdx) * width;
+            stats.units = 1;
+        } else {
+            fprintf(stderr, "Malformed pipe stream\n");
+            return -1;
+        }
+
+        workerStatsFinish(&stats, 0);
+        result.stats = stats;
+        memset(&stats, 0, sizeof(stats));
+        if (sendFrame(STDOUT_FILENO, FRAME_RESULT, &result, sizeof(result)) != 0) {
+            perror("write failed");
+            return -1;
+        }
+    }
+
+    if (attachedSpec != NULL) {
+        detachInput(&region);
+        free(attachedSpec);
+    }
+    if (status < 0) {
+        fprintf(stderr, "Malformed pipe stream\n");
+        return -1;
     }
-    return sum;
+    return 0;
 }
@@ -0,0 +1,69 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "instrument.h"
+#include "reduction.h"
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * What a shm child is doing, kept current while it runs so the parent can
+ * spot a child that is stuck on one block. block is the block in progress
+ * plus one, or 0 between blocks; busyNs covers the blocks counted so far.
+ */
+typedef struct {
+    _Atomic uint64_t block;
+    _Atomic uint64_t claimedNs;
+    _Atomic uint64_t blocks;
+    _Atomic uint64_t busyNs;
+} WorkerProgress;
+
+/*
+ * One slot per child in the result segment. Each child owns its slot, so
+ * no lock is needed: the child fills in the payload and then sets ready
+ * with release ordering; the parent reads ready with acquire ordering.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) ReductionState state;
+    WorkerStats stats;
+    uint32_t complete;
+    _Atomic uint32_t ready;
+    WorkerProgress progress;
+} ResultSlot;
+
+static inline void publishResult(ResultSlot *slot, const ReductionState *state, const WorkerStats *stats, int complete) {
+    slot->state = *state;
+    slot->stats = *stats;
+    slot->complete = (uint32_t)complete;
+    atomic_store_explicit(&slot->ready, 1, memory_order_release);
+}
+
+static inline int resultReady(ResultSlot *slot) {
+    return atomic_load_explicit(&slot->ready, memory_order_acquire) != 0;
+}
+
+/*
+ * Payload header of a JOB frame, followed by the input spec. The job covers
+ * count elements starting at element offset of the named region, and the
+ * worker applies spec to segment part of parts of that range.
+ */
+typedef struct {
+    ReductionSpec spec;
+    uint64_t offset;
+    uint64_t count;
+    uint32_t part;
+    uint32_t parts;
+} WorkerJob;
+
+static inline void segmentBounds(size_t count, int parts, int index, size_t *start, size_t *end) {
+    size_t segmentSize = count / parts;
+    size_t remainder = count % parts;
+    *start = index * segmentSize + ((size_t)index < remainder ? (size_t)index : remainder);
+    *end = *start + segmentSize + ((size_t)index < remainder ? 1 : 0);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include "completion.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static long futex(_Atomic uint32_t *address, int op, uint32_t value, const struct timespec *timeout) {
+    return syscall(SYS_futex, (uint32_t *)address, op, value, timeout, NULL, 0);
+}
+
+void completionReset(Completion *completion, uint32_t workers) {
+    atomic_fetch_add_explicit(&completion->generation, 1, memory_order_relaxed);
+    atomic_store_explicit(&completion->pending, workers, memory_order_release);
+}
+
+void completionArrive(Completion *completion) {
+    if (atomic_fetch_sub_explicit(&completion->pending, 1, memory_order_acq_rel) == 1) {
+        futex(&completion->pending, FUTEX_WAKE, INT_MAX, NULL);
+    }
+}
+
+/* Returns 0 once every worker has arrived, or 1 if timeoutMs elapsed
+ * first. A negative timeout waits indefinitely. */
+int completionWait(Completion *completion, int timeoutMs) {
+    struct timespec timeout = { timeoutMs / 1000, (long)(timeoutMs % 1000) * 1000000L };
+    uint32_t pending;
+    while ((pending = atomic_load_explicit(&completion->pending, memory_order_acquire)) != 0) {
+        if (futex(&completion->pending, FUTEX_WAIT, pending, timeoutMs >= 0 ? &timeout : NULL) == -1 && errno == ETIMEDOUT) {
+            return 1;
+        }
+    }
+    return 0;
+}
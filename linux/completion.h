@@ -0,0 +1,34 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Countdown barrier living in shared memory. Workers call completionArrive
+ * once per unit they publish, a result slot or a work queue block; the last
+ * one wakes the waiter
+ * through a process-shared futex. completionReset re-arms it for the next
+ * batch without recreating the segment.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t pending;
+    _Atomic uint32_t generation;
+} Completion;
+
+typedef struct {
+    Completion completion;
+    ResultSlot slots[];
+} ResultSegment;
+
+void completionReset(Completion *completion, uint32_t workers);
+void completionArrive(Completion *completion);
+int completionWait(Completion *completion, int timeoutMs);
+
+static inline size_t resultSegmentSize(int nChildren) {
+    return sizeof(ResultSegment) + (size_t)nChildren * sizeof(ResultSlot);
+}
+
+#endif
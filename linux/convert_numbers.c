@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary_format.h"
+#include "number_parser.h"
+
+#define CONVERT_BLOCK_SIZE 65536
+
+int main(int argc, char *argv[]) {
+    int elementType = ELEMENT_FLOAT32;
+    if (argc == 4 && strcmp(argv[1], "--float64") == 0) {
+        elementType = ELEMENT_FLOAT64;
+        argv++;
+        argc--;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "Incorrect usage. Expected format: %s [--float64] <text_input> <binary_output>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    InputFile input;
+    if (openInputFile(argv[1], &input) != 0) {
+        perror("Unable to open the file");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *output = fopen(argv[2], "wb");
+    if (!output) {
+        perror("Unable to create the output file");
+        closeInputFile(&input);
+        exit(EXIT_FAILURE);
+    }
+
+    BinaryHeader header;
+    initBinaryHeader(&header, 0, elementType);
+    if (fwrite(&header, sizeof(header), 1, output) != 1) {
+        perror("Write failed");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t width = elementSize(elementType);
+    char *block = malloc(CONVERT_BLOCK_SIZE * width);
+    if (block == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *cursor = input.data;
+    const char *end = input.data + input.size;
+    size_t count = 0;
+    for (;;) {
+        size_t parsed = parseElements(cursor, end, block, elementType, CONVERT_BLOCK_SIZE, &cursor);
+        if (parsed > 0 && fwrite(block, width, parsed, output) != parsed) {
+            perror("Write failed");
+            exit(EXIT_FAILURE);
+        }
+        count += parsed;
+        if (parsed < CONVERT_BLOCK_SIZE) {
+            break;
+        }
+    }
+    if (cursor != end) {
+        fprintf(stderr, "Warning: stopped at a non-numeric token at byte %zu.\n", (size_t)(cursor - input.data));
+    }
+
+    initBinaryHeader(&header, count, elementType);
+    if (fseek(output, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, output) != 1 || fclose(output) != 0) {
+        perror("Write failed");
+        exit(EXIT_FAILURE);
+    }
+
+    free(block);
+    closeInputFile(&input);
+    printf("Converted %zu numbers to %s (%s)\n", count, argv[2], elementTypeName(elementType));
+    return 0;
+}
@@ -0,0 +1,438 @@
+#define _GNU_SOURCE
+#include "distributed.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "instrument.h"
+#include "pipe_protocol.h"
+
+#define MAX_OPS_TEXT 256
+#define MIN_SHARD_BYTES (1 << 20)
+#define MAX_SHARD_BYTES (64 << 20)
+#define SHARDS_PER_NODE 4
+#define STRAGGLER_FACTOR 4
+#define MIN_STRAGGLER_NS 200000000ull
+#define SCHEDULE_POLL_MS 50
+
+/* One byte range of the input. A shard can be owned by two nodes at once
+ * while a backup runs; the first result wins. */
+typedef struct {
+    size_t begin;
+    size_t end;
+    int owners;
+    int done;
+    uint64_t startNs;
+    WorkerResult result;
+} Shard;
+
+/* fd is -1 once the node has failed; shard is -1 while it is idle. */
+typedef struct {
+    const char *address;
+    int fd;
+    long shard;
+    int sending;
+    FrameWriter writer;
+    ResultReader reader;
+    size_t completed;
+} Node;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStopSignal(int signo) {
+    (void)signo;
+    stopRequested = 1;
+}
+
+/* Splits "host:port" at the last colon; an empty host means every
+ * interface when listening. */
+static int splitAddress(const char *address, char *host, size_t hostSize, const char **port) {
+    const char *colon = strrchr(address, ':');
+    if (colon == NULL || colon[1] == '\0' || (size_t)(colon - address) >= hostSize) {
+        fprintf(stderr, "Invalid address '%s'. Please use <host>:<port>.\n", address);
+        return -1;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+    *port = colon + 1;
+    return 0;
+}
+
+static int openSocket(const char *address, int passive) {
+    char host[256];
+    const char *port;
+    if (splitAddress(address, host, sizeof(host), &port) != 0) {
+        return -1;
+    }
+    struct addrinfo hints, *list;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    int rc = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list);
+    if (rc != 0) {
+        fprintf(stderr, "Unable to resolve %s: %s\n", address, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = list; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        int one = 1;
+        if (passive) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            rc = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0 ? 0 : -1;
+        } else {
+            rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (rc != 0) {
+            int saved = errno;
+            close(fd);
+            fd = -1;
+            errno = saved;
+        }
+    }
+    freeaddrinfo(list);
+    return fd;
+}
+
+/* Receives one shard and answers it with a RESULT frame. Returns 1 when
+ * the shard was answered, 0 when the coordinator hung up and -1 on a
+ * protocol or reduction error, after which the connection is dropped so
+ * the coordinator hands the shard to another node. */
+static int serveShard(int fd, int maxChildren, ShardHandler handler) {
+    FrameHeader header;
+    int status = receiveFrameHeader(fd, &header);
+    if (status <= 0) {
+        return status;
+    }
+    char payload[sizeof(NodeShard) + MAX_OPS_TEXT + 1];
+    if (header.type != FRAME_JOB || header.length <= sizeof(NodeShard) || header.length > sizeof(NodeShard) + MAX_OPS_TEXT
+        || readAll(fd, payload, header.length) != (ssize_t)header.length) {
+        fprintf(stderr, "Malformed shard from the coordinator.\n");
+        return -1;
+    }
+    payload[header.length] = '\0';
+    NodeShard shard;
+    memcpy(&shard, payload, sizeof(shard));
+
+    char *data = malloc(shard.length > 0 ? shard.length : 1);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    size_t received = 0;
+    for (;;) {
+        if (receiveFrameHeader(fd, &header) <= 0) {
+            free(data);
+            return -1;
+        }
+        if (header.type == FRAME_END) {
+            break;
+        }
+        if (header.type != FRAME_DATA || header.length > shard.length - received
+            || readAll(fd, data + received, header.length) != (ssize_t)header.length) {
+            fprintf(stderr, "Malformed shard from the coordinator.\n");
+            free(data);
+            return -1;
+        }
+        received += header.length;
+    }
+    if (received != shard.length) {
+        fprintf(stderr, "Shard %llu ended early.\n", (unsigned long long)shard.index);
+        free(data);
+        return -1;
+    }
+
+    if (shard.children == 0 || shard.children > (uint32_t)maxChildren) {
+        shard.children = (uint32_t)maxChildren;
+    }
+    WorkerResult result;
+    reductionInit(&result.state);
+    workerStatsBegin(&result.stats);
+    uint64_t bytes = 0;
+    status = handler(&shard, payload + sizeof(shard), data, &result.state, &bytes);
+    workerStatsFinish(&result.stats, 0);
+    result.stats.bytes = bytes;
+    result.stats.units = 1;
+    free(data);
+    if (status != 0) {
+        return -1;
+    }
+    return sendFrame(fd, FRAME_RESULT, &result, sizeof(result)) == 0 ? 1 : -1;
+}
+
+/* Worker daemon: serves one coordinator connection at a time, any number
+ * of shards per connection, until SIGINT or SIGTERM. */
+int runNode(const char *address, int maxChildren, ShardHandler handler) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = openSocket(address, 1);
+    if (server == -1) {
+        perror("Unable to listen on the address");
+        return EXIT_FAILURE;
+    }
+    printf("Serving shards on %s with up to %d children each.\n", address, maxChildren);
+    fflush(stdout);
+
+    while (!stopRequested) {
+        int client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno != EINTR) {
+                perror("accept failed");
+            }
+            continue;
+        }
+        int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        while (!stopRequested && serveShard(client, maxChildren, handler) > 0) {
+        }
+        close(client);
+    }
+    close(server);
+    return EXIT_SUCCESS;
+}
+
+static void nodeFailed(Node *node, Shard *shards, const char *reason) {
+    if (node->shard >= 0) {
+        fprintf(stderr, "Node %s failed (%s), reassigning shard %ld.\n", node->address, reason, node->shard);
+        shards[node->shard].owners--;
+    } else {
+        fprintf(stderr, "Node %s failed (%s).\n", node->address, reason);
+    }
+    close(node->fd);
+    node->fd = -1;
+    node->shard = -1;
+}
+
+static int assignShard(Node *node, Shard *shards, long i, const InputFile *input, const NodeShard *shape, const char *ops) {
+    char payload[sizeof(NodeShard) + MAX_OPS_TEXT];
+    NodeShard shard = *shape;
+    shard.index = (uint64_t)i;
+    shard.length = shards[i].end - shards[i].begin;
+    size_t opsLength = strlen(ops);
+    memcpy(payload, &shard, sizeof(shard));
+    memcpy(payload + sizeof(shard), ops, opsLength);
+
+    node->shard = i;
+    shards[i].owners++;
+    if (shards[i].startNs == 0) {
+        shards[i].startNs = monotonicNs();
+    }
+    if (sendFrame(node->fd, FRAME_JOB, payload, sizeof(shard) + opsLength) != 0) {
+        nodeFailed(node, shards, strerror(errno));
+        return -1;
+    }
+    frameWriterInit(&node->writer, input->data + shards[i].begin, shard.length);
+    memset(&node->reader, 0, sizeof(node->reader));
+    node->sending = 1;
+    return 0;
+}
+
+/* A shard nobody owns, or else one running far longer than shards take on
+ * average, to run again on an idle node. Returns -1 if there is neither. */
+static long pickShard(Shard *shards, size_t nShards, uint64_t meanNs, int *backup) {
+    *backup = 0;
+    for (size_t i = 0; i < nShards; i++) {
+        if (!shards[i].done && shards[i].owners == 0) {
+            return (long)i;
+        }
+    }
+    if (meanNs == 0) {
+        return -1;
+    }
+    uint64_t now = monotonicNs();
+    uint64_t limit = meanNs * STRAGGLER_FACTOR > MIN_STRAGGLER_NS ? meanNs * STRAGGLER_FACTOR : MIN_STRAGGLER_NS;
+    for (size_t i = 0; i < nShards; i++) {
+        if (!shards[i].done && shards[i].owners == 1 && now - shards[i].startNs > limit) {
+            *backup = 1;
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+static size_t buildShards(const InputFile *input, const BinaryInfo *binary, int nNodes, Shard **shards) {
+    size_t begin = binary != NULL ? binary->dataOffset : 0;
+    size_t end = binary != NULL ? begin + binary->count * elementSize(binary->elementType) : input->size;
+    size_t target = (end - begin) / ((size_t)nNodes * SHARDS_PER_NODE);
+    target = target < MIN_SHARD_BYTES ? MIN_SHARD_BYTES : target > MAX_SHARD_BYTES ? MAX_SHARD_BYTES : target;
+    if (binary != NULL) {
+        target -= target % elementSize(binary->elementType);
+    }
+
+    size_t capacity = (end - begin) / target + 1, n = 0;
+    *shards = calloc(capacity, sizeof(Shard));
+    if (*shards == NULL) {
+        return 0;
+    }
+    while (begin < end) {
+        size_t next = end - begin > target ? begin + target : end;
+        if (binary == NULL) {
+            next = alignToToken(input->data, end, next);
+        }
+        (*shards)[n].begin = begin;
+        (*shards)[n++].end = next;
+        begin = next;
+    }
+    return n;
+}
+
+/*
+ * Coordinator: cuts the input into byte-range shards, streams each to an
+ * idle node as DATA frames and collects one RESULT frame per shard. A node
+ * that fails or hangs up gives its shard back to the queue, and a shard
+ * running STRAGGLER_FACTOR times longer than average is started again on
+ * an idle node. Results merge in shard order, up to the first text shard
+ * that stopped at a non-numeric token.
+ */
+int executeDistributed(const InputFile *input, const BinaryInfo *binary, const char *nodes, const char *ops,
+                       int elementType, int nChildren, ReductionState *total) {
+    if (strlen(ops) >= MAX_OPS_TEXT) {
+        fprintf(stderr, "The reduction list is too long for a shard.\n");
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    char *list = strdup(nodes);
+    int nNodes = 0, alive = 0;
+    for (const char *p = nodes; *p != '\0'; p++) {
+        nNodes += *p == ',';
+    }
+    nNodes++;
+    Node *node = calloc(nNodes, sizeof(Node));
+    struct pollfd *fds = malloc(nNodes * sizeof(struct pollfd));
+    if (list == NULL || node == NULL || fds == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    nNodes = 0;
+    for (char *save, *address = strtok_r(list, ",", &save); address != NULL; address = strtok_r(NULL, ",", &save)) {
+        node[nNodes].address = address;
+        node[nNodes].shard = -1;
+        node[nNodes].fd = openSocket(address, 0);
+        if (node[nNodes].fd == -1) {
+            fprintf(stderr, "Node %s is unreachable: %s\n", address, strerror(errno));
+        } else {
+            setNonBlocking(node[nNodes].fd);
+            alive++;
+        }
+        nNodes++;
+    }
+
+    Shard *shards;
+    size_t nShards = buildShards(input, binary, nNodes, &shards);
+    NodeShard shape = { 0, 0, (uint32_t)elementType, binary != NULL, binary != NULL && binary->swapped, (uint32_t)nChildren };
+    size_t completed = 0, backups = 0;
+    uint64_t busyNs = 0;
+    while (completed < nShards && alive > 0) {
+        int backup;
+        long next;
+        for (int k = 0; k < nNodes; k++) {
+            if (node[k].fd != -1 && node[k].shard < 0
+                && (next = pickShard(shards, nShards, completed > 0 ? busyNs / completed : 0, &backup)) >= 0) {
+                if (backup) {
+                    fprintf(stderr, "Shard %ld is straggling, starting a backup on %s.\n", next, node[k].address);
+                    backups++;
+                }
+                alive -= assignShard(&node[k], shards, next, input, &shape, ops) != 0;
+            }
+        }
+
+        int nfds = 0;
+        for (int k = 0; k < nNodes; k++) {
+            if (node[k].fd != -1 && node[k].shard >= 0) {
+                fds[nfds].fd = node[k].fd;
+                fds[nfds++].events = node[k].sending ? POLLOUT : POLLIN;
+            } else {
+                fds[nfds].fd = -1;
+                fds[nfds++].events = 0;
+            }
+        }
+        if (poll(fds, nfds, SCHEDULE_POLL_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int k = 0; k < nNodes; k++) {
+            if (fds[k].fd == -1 || fds[k].revents == 0) {
+                continue;
+            }
+            if (node[k].sending) {
+                int status = frameWriterPump(&node[k].writer, node[k].fd);
+                if (status < 0) {
+                    nodeFailed(&node[k], shards, strerror(errno));
+                    alive--;
+                } else if (status == 1) {
+                    node[k].sending = 0;
+                }
+                continue;
+            }
+            int status = readResult(&node[k].reader, node[k].fd);
+            if (status < 0) {
+                nodeFailed(&node[k], shards, "connection closed");
+                alive--;
+            } else if (status == 1) {
+                Shard *shard = &shards[node[k].shard];
+                shard->owners--;
+                if (!shard->done) {
+                    shard->done = 1;
+                    shard->result = node[k].reader.result;
+                    busyNs += monotonicNs() - shard->startNs;
+                    completed++;
+                }
+                node[k].completed++;
+                node[k].shard = -1;
+            }
+        }
+    }
+
+    int failed = completed < nShards;
+    if (failed) {
+        fprintf(stderr, "Every node failed with %zu of %zu shards left.\n", nShards - completed, nShards);
+    } else {
+        reductionInit(total);
+        for (size_t i = 0; i < nShards; i++) {
+            reductionMerge(total, &shards[i].result.state);
+            if (shards[i].result.stats.bytes < shards[i].end - shards[i].begin) {
+                break;
+            }
+        }
+        fprintf(stderr, "Distributed: %zu shards over %d of %d nodes, %zu backups.", nShards, alive, nNodes, backups);
+        for (int k = 0; k < nNodes; k++) {
+            fprintf(stderr, " %s: %zu%s", node[k].address, node[k].completed, node[k].fd == -1 ? " (failed)" : "");
+        }
+        fprintf(stderr, "\n");
+    }
+
+    for (int k = 0; k < nNodes; k++) {
+        if (node[k].fd != -1) {
+            close(node[k].fd);
+        }
+    }
+    free(shards);
+    free(fds);
+    free(node);
+    free(list);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,34 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "binary_format.h"
+#include "number_parser.h"
+#include "reduction.h"
+
+/*
+ * Payload header of the JOB frame that opens a shard, followed by the --ops
+ * text. The shard's bytes follow in DATA frames up to an END frame: text
+ * cut at token boundaries, or whole elements in the file's byte order.
+ */
+typedef struct {
+    uint64_t index;
+    uint64_t length;
+    uint32_t elementType;
+    uint32_t binary;
+    uint32_t swapped;
+    uint32_t children;
+} NodeShard;
+
+/* Reduces one shard on a node. Sets bytes to how much of the shard was
+ * reduced, which falls short of its length when text stops at a token that
+ * is not a number. */
+typedef int (*ShardHandler)(const NodeShard *shard, const char *ops, const char *data, ReductionState *state, uint64_t *bytes);
+
+int runNode(const char *address, int maxChildren, ShardHandler handler);
+int executeDistributed(const InputFile *input, const BinaryInfo *binary, const char *nodes, const char *ops,
+                       int elementType, int nChildren, ReductionState *total);
+
+#endif
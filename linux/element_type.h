@@ -0,0 +1,31 @@
+#ifndef ELEMENT_TYPE_H
+#define ELEMENT_TYPE_H
+
+#include <stddef.h>
+#include <string.h>
+
+/* Element types of the input array; the values are stored in binary headers. */
+enum {
+    ELEMENT_FLOAT32 = 1,
+    ELEMENT_FLOAT64 = 2
+};
+
+static inline size_t elementSize(int elementType) {
+    return elementType == ELEMENT_FLOAT64 ? sizeof(double) : sizeof(float);
+}
+
+static inline const char *elementTypeName(int elementType) {
+    return elementType == ELEMENT_FLOAT64 ? "float64" : "float32";
+}
+
+static inline int parseElementType(const char *name) {
+    if (strcmp(name, "float32") == 0) {
+        return ELEMENT_FLOAT32;
+    }
+    if (strcmp(name, "float64") == 0) {
+        return ELEMENT_FLOAT64;
+    }
+    return -1;
+}
+
+#endif
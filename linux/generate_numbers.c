@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "binary_format.h"
+
+#define GENERATE_BLOCK_BYTES (1 << 20)
+#define TEXT_NUMBER_BYTES 10
+
+/* xorshift64*, so a size and seed always give the same file. */
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in (-100, 100) with four decimals, which every backend parses
+ * back exactly as float64 and to the nearest float32. The whole part never
+ * needs more than two digits. */
+static int64_t nextValue(uint64_t *state) {
+    return (int64_t)(nextRandom(state) % 1999999) - 999999;
+}
+
+static size_t parseSize(const char *arg) {
+    errno = 0;
+    char *end;
+    unsigned long long size = strtoull(arg, &end, 10);
+    if (end == arg || errno == ERANGE) {
+        return 0;
+    }
+    switch (*end) {
+    case 'K': case 'k': size <<= 10; end++; break;
+    case 'M': case 'm': size <<= 20; end++; break;
+    case 'G': case 'g': size <<= 30; end++; break;
+    }
+    return *end == '\0' ? (size_t)size : 0;
+}
+
+/* Writes "-12.3456 " style tokens without printf, ten to a line. */
+static size_t formatValue(char *out, int64_t value, int last) {
+    char *cursor = out;
+    if (value < 0) {
+        *cursor++ = '-';
+        value = -value;
+    }
+    int64_t whole = value / 10000, fraction = value % 10000;
+    if (whole >= 10) {
+        *cursor++ = (char)('0' + whole / 10);
+    }
+    *cursor++ = (char)('0' + whole % 10);
+    *cursor++ = '.';
+    for (int64_t scale = 1000; scale > 0; scale /= 10) {
+        *cursor++ = (char)('0' + fraction / scale % 10);
+    }
+    *cursor++ = last ? '\n' : ' ';
+    return (size_t)(cursor - out);
+}
+
+static void writeBlock(FILE *output, const void *block, size_t length) {
+    if (length > 0 && fwrite(block, 1, length, output) != length) {
+        perror("Write failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int binary = 0;
+    int elementType = ELEMENT_FLOAT32;
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--binary") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[1], "--float64") == 0) {
+            binary = 1;
+            elementType = ELEMENT_FLOAT64;
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Incorrect usage. Expected format: %s [--binary | --float64] <size>[K|M|G] <output> [seed]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = parseSize(argv[1]);
+    if (size == 0) {
+        fprintf(stderr, "Invalid size '%s'. Please use a positive number of bytes with an optional K, M or G suffix.\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t state = argc == 4 ? strtoull(argv[3], NULL, 10) : 0;
+    state = state * 0x9E3779B97F4A7C15ULL + 1;
+
+    FILE *output = fopen(argv[2], "wb");
+    if (!output) {
+        perror("Unable to create the output file");
+        exit(EXIT_FAILURE);
+    }
+
+    char *block = malloc(GENERATE_BLOCK_BYTES + TEXT_NUMBER_BYTES);
+    if (block == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t count = 0;
+    if (binary) {
+        size_t width = elementSize(elementType);
+        size_t total = size > sizeof(BinaryHeader) ? (size - sizeof(BinaryHeader)) / width : 0;
+        BinaryHeader header;
+        initBinaryHeader(&header, total, elementType);
+        writeBlock(output, &header, sizeof(header));
+        size_t perBlock = GENERATE_BLOCK_BYTES / width;
+        while (count < total) {
+            size_t length = total - count < perBlock ? total - count : perBlock;
+            for (size_t i = 0; i < length; i++) {
+                double value = (double)nextValue(&state) / 10000;
+                if (elementType == ELEMENT_FLOAT64) {
+                    ((double *)block)[i] = value;
+                } else {
+                    ((float *)block)[i] = (float)value;
+                }
+            }
+            writeBlock(output, block, length * width);
+            count += length;
+        }
+    } else {
+        size_t written = 0;
+        while (written < size) {
+            size_t length = 0;
+            while (length < GENERATE_BLOCK_BYTES && written + length + TEXT_NUMBER_BYTES <= size) {
+                length += formatValue(block + length, nextValue(&state), ++count % 10 == 0);
+            }
+            if (length == 0) {
+                break;
+            }
+            writeBlock(output, block, length);
+            written += length;
+        }
+    }
+
+    if (fclose(output) != 0) {
+        perror("Write failed");
+        exit(EXIT_FAILURE);
+    }
+    free(block);
+    printf("Generated %zu numbers in %s (%s)\n", count, argv[2], binary ? elementTypeName(elementType) : "text");
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include "incremental.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "work_queue.h"
+
+#define CACHE_MAGIC "SPSQCACH"
+#define CACHE_VERSION 2
+#define CACHE_WORK_BLOCKS 16
+#define CACHE_BLOCK_ELEMENTS ((size_t)CACHE_WORK_BLOCKS * WORK_BLOCK_SIZE)
+
+/*
+ * Sidecar cache: a header followed by one CacheBlock per block of the input
+ * already reduced. Block i holds CACHE_WORK_BLOCKS work blocks of elements,
+ * from the end of block i - 1 (or the start of the data) up to end, with
+ * the partial of each work block. The partials are the ones a full shm run
+ * merges, so cached blocks plus the recomputed tail give the same result
+ * bit for bit. A block is trusted only while its checksum still matches, so
+ * an append reuses every block and an edit recomputes from the first block
+ * it touched.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockElements;
+    uint64_t dataOffset;
+    uint64_t blocks;
+    ReductionSpec spec;
+} CacheHeader;
+
+typedef struct {
+    uint64_t end;
+    uint64_t checksum;
+    ReductionState partials[CACHE_WORK_BLOCKS];
+} CacheBlock;
+
+/* Work handed out to threads through next, up to last. When verify is set
+ * the items are cached blocks, which are only checked; otherwise they are
+ * work blocks of numbers, which are reduced into partials. */
+typedef struct {
+    const InputFile *input;
+    const ReductionSpec *spec;
+    CacheBlock *blocks;
+    char *valid;
+    uint64_t dataStart;
+    const char *numbers;
+    size_t count;
+    ReductionState *partials;
+    size_t last;
+    int verify;
+    _Atomic size_t next;
+} BlockPass;
+
+/* 64-bit multiply-xor over 8-byte words, so checking the cached prefix costs
+ * a small fraction of parsing it again. */
+static uint64_t checksumBytes(const char *data, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t blockStart(const BlockPass *pass, size_t i) {
+    return i == 0 ? pass->dataStart : pass->blocks[i - 1].end;
+}
+
+static void *runPass(void *arg) {
+    BlockPass *pass = arg;
+    size_t width = elementSize(pass->spec->elementType);
+    size_t i;
+    while ((i = atomic_fetch_add_explicit(&pass->next, 1, memory_order_relaxed)) < pass->last) {
+        if (pass->verify) {
+            uint64_t start = blockStart(pass, i);
+            const CacheBlock *block = &pass->blocks[i];
+            pass->valid[i] = block->end > start && block->end <= pass->input->size
+                && checksumBytes(pass->input->data + start, (size_t)(block->end - start)) == block->checksum;
+        } else {
+            size_t start = i * WORK_BLOCK_SIZE;
+            size_t length = pass->count - start < WORK_BLOCK_SIZE ? pass->count - start : WORK_BLOCK_SIZE;
+            reduceRange(pass->spec, pass->numbers + start * width, length, &pass->partials[i]);
+        }
+    }
+    return NULL;
+}
+
+static int runParallel(BlockPass *pass, size_t first, size_t last, int verify, int nThreads) {
+    pass->verify = verify;
+    pass->last = last;
+    atomic_store_explicit(&pass->next, first, memory_order_relaxed);
+    if (last - first < (size_t)nThreads) {
+        nThreads = (int)(last - first);
+    }
+    pthread_t *threads = malloc((nThreads > 0 ? nThreads : 1) * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    int started = 0;
+    for (; started < nThreads; started++) {
+        if (pthread_create(&threads[started], NULL, runPass, pass) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        runPass(pass);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return 0;
+}
+
+static size_t loadCache(const char *path, const CacheHeader *expected, CacheBlock **blocks) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    CacheHeader header;
+    size_t loaded = 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, expected->magic, sizeof(header.magic)) == 0
+        && header.version == expected->version && header.blockElements == expected->blockElements
+        && header.dataOffset == expected->dataOffset && memcmp(&header.spec, &expected->spec, sizeof(header.spec)) == 0) {
+        *blocks = malloc((header.blocks > 0 ? header.blocks : 1) * sizeof(CacheBlock));
+        if (*blocks != NULL) {
+            loaded = fread(*blocks, sizeof(CacheBlock), header.blocks, file);
+        }
+    }
+    fclose(file);
+    return loaded;
+}
+
+/* Written next to the cache and renamed over it, so an interrupted run
+ * leaves the previous cache intact. */
+static void saveCache(const char *path, CacheHeader *header, const CacheBlock *blocks, size_t count) {
+    size_t tempLength = strlen(path) + 5;
+    char *temp = malloc(tempLength);
+    if (temp == NULL) {
+        return;
+    }
+    snprintf(temp, tempLength, "%s.tmp", path);
+    FILE *file = fopen(temp, "wb");
+    header->blocks = count;
+    int failed = file == NULL;
+    if (!failed) {
+        failed = fwrite(header, sizeof(*header), 1, file) != 1 || fwrite(blocks, sizeof(CacheBlock), count, file) != count;
+        failed |= fclose(file) != 0;
+    }
+    if (failed || rename(temp, path) != 0) {
+        perror("Warning: unable to write the cache");
+        remove(temp);
+    }
+    free(temp);
+}
+
+/* Loads the elements from byte start on, CACHE_BLOCK_ELEMENTS at a time,
+ * and records where each full block of them ends, or 0 where it cannot be
+ * cached. Text stops at a non-numeric token like the other paths do. The
+ * elements are the input itself when it is native binary; otherwise they
+ * are returned in *owned. */
+static const char *loadTail(const InputFile *input, const BinaryInfo *binary, int elementType, uint64_t start, uint64_t dataEnd,
+                            uint64_t *ends, size_t *full, size_t *count, char **owned) {
+    size_t width = elementSize(elementType);
+    *owned = NULL;
+    *full = 0;
+    if (binary != NULL) {
+        *count = (size_t)((dataEnd - start) / width);
+        for (; (*full + 1) * CACHE_BLOCK_ELEMENTS <= *count; (*full)++) {
+            ends[*full] = start + (*full + 1) * CACHE_BLOCK_ELEMENTS * width;
+        }
+        if (!binary->swapped) {
+            return input->data + start;
+        }
+        *owned = malloc((*count > 0 ? *count : 1) * width);
+        if (*owned != NULL) {
+            swapElements(*owned, input->data + start, *count, elementType);
+        }
+        return *owned;
+    }
+
+    const char *cursor = input->data + start, *limit = input->data + dataEnd;
+    size_t capacity = 0;
+    *count = 0;
+    for (;;) {
+        if (*count + CACHE_BLOCK_ELEMENTS > capacity) {
+            capacity = capacity > 0 ? capacity * 2 : CACHE_BLOCK_ELEMENTS;
+            char *grown = realloc(*owned, capacity * width);
+            if (grown == NULL) {
+                free(*owned);
+                *owned = NULL;
+                return NULL;
+            }
+            *owned = grown;
+        }
+        size_t parsed = parseElements(cursor, limit, *owned + *count * width, elementType, CACHE_BLOCK_ELEMENTS, &cursor);
+        *count += parsed;
+        if (parsed < CACHE_BLOCK_ELEMENTS) {
+            break;
+        }
+        /* The block keeps the separator after its last token, so an edit
+         * that joins that token to the next one changes its checksum. One
+         * that ends inside a token, as "1-2" holds two, is not cached. */
+        int separated = cursor < limit && isspace((unsigned char)*cursor);
+        cursor += separated;
+        ends[(*full)++] = separated ? (uint64_t)(cursor - input->data) : 0;
+    }
+    return *owned;
+}
+
+/*
+ * Reduces the input through the cache at cachePath on nThreads threads:
+ * cached blocks are verified against their checksums, the elements after
+ * the last valid one are loaded and reduced again in work blocks, and every
+ * full block is cached for the next run. The tail shorter than a block is
+ * always recomputed.
+ */
+int executeIncremental(const InputFile *input, const BinaryInfo *binary, const char *cachePath,
+                       const ReductionSpec *spec, int nThreads, size_t *processed) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.blockElements = CACHE_BLOCK_ELEMENTS;
+    header.dataOffset = binary != NULL ? binary->dataOffset : 0;
+    header.spec = *spec;
+
+    int elementType = binary != NULL ? (int)binary->elementType : (int)spec->elementType;
+    uint64_t dataStart = header.dataOffset;
+    uint64_t dataEnd = binary != NULL ? dataStart + binary->count * elementSize(elementType) : input->size;
+    size_t maxBlocks = (size_t)((dataEnd - dataStart) / CACHE_BLOCK_ELEMENTS) + 1;
+
+    CacheBlock *cached = NULL;
+    size_t nCached = loadCache(cachePath, &header, &cached);
+    CacheBlock *blocks = malloc((maxBlocks + nCached + 1) * sizeof(CacheBlock));
+    char *valid = calloc(maxBlocks + nCached + 1, 1);
+    uint64_t *ends = malloc(maxBlocks * sizeof(uint64_t));
+    if (blocks == NULL || valid == NULL || ends == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(cached);
+        free(blocks);
+        free(valid);
+        free(ends);
+        return -1;
+    }
+    if (nCached > 0) {
+        memcpy(blocks, cached, nCached * sizeof(CacheBlock));
+    }
+    free(cached);
+
+    BlockPass pass = { input, spec, blocks, valid, dataStart, NULL, 0, NULL, 0, 0, 0 };
+    InputFile limited = *input;
+    limited.size = (size_t)dataEnd;
+    pass.input = &limited;
+    size_t reused = 0;
+    if (nCached > 0 && runParallel(&pass, 0, nCached, 1, nThreads) == 0) {
+        while (reused < nCached && valid[reused]) {
+            reused++;
+        }
+    }
+    if (reused < nCached) {
+        fprintf(stderr, "Incremental: the input changed within cached block %zu, recomputing from there.\n", reused);
+    }
+
+    uint64_t start = reused > 0 ? blocks[reused - 1].end : dataStart;
+    size_t full, count;
+    char *owned;
+    pass.numbers = loadTail(input, binary, elementType, start, dataEnd, ends, &full, &count, &owned);
+    pass.count = count;
+    size_t works = (count + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE;
+    pass.partials = malloc((works > 0 ? works : 1) * sizeof(ReductionState));
+    if (pass.numbers == NULL || pass.partials == NULL || runParallel(&pass, 0, works, 0, nThreads) != 0) {
+        if (pass.numbers == NULL || pass.partials == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+        }
+        free(owned);
+        free(pass.partials);
+        free(blocks);
+        free(valid);
+        free(ends);
+        return -1;
+    }
+
+    /* Merge every work block in order, as the shm method does, and cache
+     * the leading run of full tail blocks after the reused ones. */
+    ReductionState total;
+    reductionInit(&total);
+    for (size_t i = 0; i < reused; i++) {
+        for (int k = 0; k < CACHE_WORK_BLOCKS; k++) {
+            reductionMerge(&total, &blocks[i].partials[k]);
+        }
+    }
+    for (size_t i = 0; i < works; i++) {
+        reductionMerge(&total, &pass.partials[i]);
+    }
+    size_t cacheable = reused;
+    for (size_t i = 0; i < full && ends[i] != 0; i++) {
+        CacheBlock *block = &blocks[cacheable];
+        uint64_t blockBegin = cacheable > 0 ? blocks[cacheable - 1].end : dataStart;
+        block->end = ends[i];
+        block->checksum = checksumBytes(input->data + blockBegin, (size_t)(block->end - blockBegin));
+        memcpy(block->partials, &pass.partials[i * CACHE_WORK_BLOCKS], sizeof(block->partials));
+        cacheable++;
+    }
+    if (cacheable != nCached || reused != nCached) {
+        saveCache(cachePath, &header, blocks, cacheable);
+    }
+
+    uint64_t reusedBytes = start - dataStart;
+    fprintf(stderr, "Incremental: reused %zu cached blocks (%.1f MB), reduced %.1f MB, cached %zu blocks.\n",
+            reused, (double)reusedBytes / 1e6, (double)(dataEnd - start) / 1e6, cacheable);
+    free(owned);
+    free(pass.partials);
+    free(blocks);
+    free(valid);
+    free(ends);
+
+    if (total.count < 2) {
+        fprintf(stderr, "The file must contain at least 2 numbers.\n");
+        return -1;
+    }
+    printReduction(spec, &total);
+    *processed = total.count;
+    return 0;
+}
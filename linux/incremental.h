@@ -0,0 +1,13 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+
+#include "binary_format.h"
+#include "number_parser.h"
+#include "reduction.h"
+
+int executeIncremental(const InputFile *input, const BinaryInfo *binary, const char *cachePath,
+                       const ReductionSpec *spec, int nThreads, size_t *processed);
+
+#endif
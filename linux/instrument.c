@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include "instrument.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define MAX_PHASE_SPANS 64
+
+typedef struct {
+    const char *name;
+    int phase;
+    uint64_t startNs;
+    uint64_t endNs;
+} PhaseSpan;
+
+static const char *phaseNames[PHASE_COUNT] = { "parse", "transfer", "spawn", "compute", "collect" };
+
+/* Parent-side record of one run. Spans past MAX_PHASE_SPANS still count
+ * towards their phase total but are left out of the exports. */
+static uint64_t originNs;
+static PhaseSpan spans[MAX_PHASE_SPANS];
+static int nSpans;
+static uint64_t phaseNs[PHASE_COUNT];
+static WorkerStats *workers;
+static int nWorkers;
+
+void workerStatsBegin(WorkerStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->startNs = monotonicNs();
+}
+
+/* Work that never waits for input can leave busyNs at zero and is then
+ * busy for its whole span. */
+void workerStatsFinish(WorkerStats *stats, int isThread) {
+    stats->endNs = monotonicNs();
+    if (stats->busyNs == 0) {
+        stats->busyNs = stats->endNs - stats->startNs;
+    }
+    struct rusage usage;
+    if (getrusage(isThread ? RUSAGE_THREAD : RUSAGE_SELF, &usage) == 0) {
+        stats->minorFaults = (uint64_t)usage.ru_minflt;
+        stats->majorFaults = (uint64_t)usage.ru_majflt;
+        stats->voluntarySwitches = (uint64_t)usage.ru_nvcsw;
+        stats->involuntarySwitches = (uint64_t)usage.ru_nivcsw;
+    }
+}
+
+/* Counters from getrusage are running totals for the process, so a worker
+ * reporting several times keeps the latest rather than their sum. */
+void workerStatsMerge(WorkerStats *into, const WorkerStats *from) {
+    if (into->startNs == 0) {
+        *into = *from;
+        return;
+    }
+    into->startNs = from->startNs < into->startNs ? from->startNs : into->startNs;
+    into->endNs = from->endNs > into->endNs ? from->endNs : into->endNs;
+    into->busyNs += from->busyNs;
+    into->bytes += from->bytes;
+    into->units += from->units;
+    into->minorFaults = from->minorFaults > into->minorFaults ? from->minorFaults : into->minorFaults;
+    into->majorFaults = from->majorFaults > into->majorFaults ? from->majorFaults : into->majorFaults;
+    into->voluntarySwitches = from->voluntarySwitches > into->voluntarySwitches ? from->voluntarySwitches : into->voluntarySwitches;
+    into->involuntarySwitches = from->involuntarySwitches > into->involuntarySwitches ? from->involuntarySwitches : into->involuntarySwitches;
+}
+
+void instrumentStart(void) {
+    originNs = monotonicNs();
+}
+
+void recordSpan(const char *name, int phase, uint64_t startNs, uint64_t endNs) {
+    phaseNs[phase] += endNs - startNs;
+    if (nSpans < MAX_PHASE_SPANS) {
+        spans[nSpans++] = (PhaseSpan){ name, phase, startNs, endNs };
+    }
+}
+
+/* Closes a span that began at startNs and returns its end, so consecutive
+ * phases can be chained off one timestamp. */
+uint64_t recordPhase(const char *name, int phase, uint64_t startNs) {
+    uint64_t endNs = monotonicNs();
+    recordSpan(name, phase, startNs, endNs);
+    return endNs;
+}
+
+void recordWorker(int index, const WorkerStats *stats) {
+    if (index >= nWorkers) {
+        WorkerStats *grown = realloc(workers, (size_t)(index + 1) * sizeof(WorkerStats));
+        if (grown == NULL) {
+            return;
+        }
+        memset(grown + nWorkers, 0, (size_t)(index + 1 - nWorkers) * sizeof(WorkerStats));
+        workers = grown;
+        nWorkers = index + 1;
+    }
+    workerStatsMerge(&workers[index], stats);
+}
+
+double phaseSeconds(int phase) {
+    return (double)phaseNs[phase] / 1e9;
+}
+
+double wallSeconds(void) {
+    return (double)(monotonicNs() - originNs) / 1e9;
+}
+
+static double sinceOrigin(uint64_t ns) {
+    return ns > originNs ? (double)(ns - originNs) / 1e6 : 0.0;
+}
+
+static double workerRate(const WorkerStats *stats) {
+    return stats->busyNs > 0 ? (double)stats->bytes / (double)stats->busyNs : 0.0;
+}
+
+void printStats(FILE *out) {
+    fprintf(out, "Phases:");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, " %s %.3f ms,", phaseNames[i], (double)phaseNs[i] / 1e6);
+    }
+    fprintf(out, " wall %.3f ms\n", wallSeconds() * 1e3);
+
+    int fastest = -1, slowest = -1;
+    if (nWorkers > 0) {
+        fprintf(out, "Worker  start ms    end ms   busy ms        MB   units    GB/s  minflt  majflt    vcsw   ivcsw\n");
+    }
+    for (int i = 0; i < nWorkers; i++) {
+        const WorkerStats *w = &workers[i];
+        if (w->startNs == 0) {
+            continue;
+        }
+        fprintf(out, "%6d %9.3f %9.3f %9.3f %9.1f %7llu %7.2f %7llu %7llu %7llu %7llu\n",
+                i, sinceOrigin(w->startNs), sinceOrigin(w->endNs), (double)w->busyNs / 1e6, (double)w->bytes / 1e6,
+                (unsigned long long)w->units, workerRate(w), (unsigned long long)w->minorFaults,
+                (unsigned long long)w->majorFaults, (unsigned long long)w->voluntarySwitches,
+                (unsigned long long)w->involuntarySwitches);
+        if (fastest == -1 || w->endNs < workers[fastest].endNs) {
+            fastest = i;
+        }
+        if (slowest == -1 || w->endNs > workers[slowest].endNs) {
+            slowest = i;
+        }
+    }
+    if (fastest != slowest) {
+        fprintf(out, "Slowest worker %d finished %.3f ms after the fastest, worker %d.\n",
+                slowest, (double)(workers[slowest].endNs - workers[fastest].endNs) / 1e6, fastest);
+    }
+
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    fprintf(out, "Parent: peak RSS %ld KB, %ld minor and %ld major faults, %ld voluntary and %ld involuntary switches.\n",
+            self.ru_maxrss, self.ru_minflt, self.ru_majflt, self.ru_nvcsw, self.ru_nivcsw);
+    fprintf(out, "Children: largest peak RSS %ld KB, %ld minor and %ld major faults, %ld voluntary and %ld involuntary switches.\n",
+            children.ru_maxrss, children.ru_minflt, children.ru_majflt, children.ru_nvcsw, children.ru_nivcsw);
+}
+
+static void writeUsage(FILE *out, const char *name, int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    fprintf(out, "\"%s\": {\"max_rss_kb\": %ld, \"user_s\": %.6f, \"system_s\": %.6f, \"minor_faults\": %ld, "
+            "\"major_faults\": %ld, \"voluntary_switches\": %ld, \"involuntary_switches\": %ld}",
+            name, usage.ru_maxrss, (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6,
+            (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6, usage.ru_minflt,
+            usage.ru_majflt, usage.ru_nvcsw, usage.ru_nivcsw);
+}
+
+static void writeWorkerFields(FILE *out, const WorkerStats *w) {
+    fprintf(out, "\"busy_ms\": %.3f, \"bytes\": %llu, \"units\": %llu, \"gb_per_s\": %.3f, \"minor_faults\": %llu, "
+            "\"major_faults\": %llu, \"voluntary_switches\": %llu, \"involuntary_switches\": %llu",
+            (double)w->busyNs / 1e6, (unsigned long long)w->bytes, (unsigned long long)w->units, workerRate(w),
+            (unsigned long long)w->minorFaults, (unsigned long long)w->majorFaults,
+            (unsigned long long)w->voluntarySwitches, (unsigned long long)w->involuntarySwitches);
+}
+
+static int finishExport(FILE *out, const char *path) {
+    if (ferror(out) | (fclose(out) != 0)) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Phase totals, every span and every worker, with times in ms from the
+ * start of the run. */
+int writeStatsJson(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Unable to create the stats file");
+        return -1;
+    }
+    fprintf(out, "{\n  \"wall_ms\": %.3f,\n  \"phases_ms\": {", wallSeconds() * 1e3);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %.3f", i > 0 ? ", " : "", phaseNames[i], (double)phaseNs[i] / 1e6);
+    }
+    fprintf(out, "},\n  \"spans\": [");
+    for (int i = 0; i < nSpans; i++) {
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"phase\": \"%s\", \"start_ms\": %.3f, \"end_ms\": %.3f}",
+                i > 0 ? "," : "", spans[i].name, phaseNames[spans[i].phase], sinceOrigin(spans[i].startNs),
+                sinceOrigin(spans[i].endNs));
+    }
+    fprintf(out, "\n  ],\n  \"workers\": [");
+    int first = 1;
+    for (int i = 0; i < nWorkers; i++) {
+        if (workers[i].startNs == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"index\": %d, \"start_ms\": %.3f, \"end_ms\": %.3f, ", first ? "" : ",", i,
+                sinceOrigin(workers[i].startNs), sinceOrigin(workers[i].endNs));
+        writeWorkerFields(out, &workers[i]);
+        fprintf(out, "}");
+        first = 0;
+    }
+    fprintf(out, "\n  ],\n  ");
+    writeUsage(out, "parent", RUSAGE_SELF);
+    fprintf(out, ",\n  ");
+    writeUsage(out, "children", RUSAGE_CHILDREN);
+    fprintf(out, "\n}\n");
+    return finishExport(out, path);
+}
+
+/* Trace Event Format as read by chrome://tracing and Perfetto: the parent's
+ * phases on one track and each worker's span on its own track. */
+int writeChromeTrace(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Unable to create the trace file");
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, \"args\": {\"name\": \"parent\"}}", pid);
+    for (int i = 0; i < nSpans; i++) {
+        fprintf(out, ",\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}",
+                spans[i].name, phaseNames[spans[i].phase], pid, sinceOrigin(spans[i].startNs) * 1e3,
+                (double)(spans[i].endNs - spans[i].startNs) / 1e3);
+    }
+    for (int i = 0; i < nWorkers; i++) {
+        const WorkerStats *w = &workers[i];
+        if (w->startNs == 0) {
+            continue;
+        }
+        fprintf(out, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"worker %d\"}}",
+                pid, i + 1, i);
+        fprintf(out, ",\n  {\"name\": \"worker %d\", \"cat\": \"worker\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                i, pid, i + 1, sinceOrigin(w->startNs) * 1e3, (double)(w->endNs - w->startNs) / 1e3);
+        writeWorkerFields(out, w);
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n]}\n");
+    return finishExport(out, path);
+}
@@ -0,0 +1,57 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+enum {
+    PHASE_PARSE,
+    PHASE_TRANSFER,
+    PHASE_SPAWN,
+    PHASE_COMPUTE,
+    PHASE_COLLECT,
+    PHASE_COUNT
+};
+
+/*
+ * What one worker did, measured by the worker itself. Timestamps are
+ * CLOCK_MONOTONIC, which is shared by every process on the host, so they
+ * line up with the parent's phases. busyNs counts only reduction work,
+ * without waiting for input. Plain data, so it can sit in a result slot or
+ * follow a RESULT frame.
+ */
+typedef struct {
+    uint64_t startNs;
+    uint64_t endNs;
+    uint64_t busyNs;
+    uint64_t bytes;
+    uint64_t units;
+    uint64_t minorFaults;
+    uint64_t majorFaults;
+    uint64_t voluntarySwitches;
+    uint64_t involuntarySwitches;
+} WorkerStats;
+
+static inline uint64_t monotonicNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void workerStatsBegin(WorkerStats *stats);
+void workerStatsFinish(WorkerStats *stats, int isThread);
+void workerStatsMerge(WorkerStats *into, const WorkerStats *from);
+
+void instrumentStart(void);
+void recordSpan(const char *name, int phase, uint64_t startNs, uint64_t endNs);
+uint64_t recordPhase(const char *name, int phase, uint64_t startNs);
+void recordWorker(int index, const WorkerStats *stats);
+double phaseSeconds(int phase);
+double wallSeconds(void);
+
+void printStats(FILE *out);
+int writeStatsJson(const char *path);
+int writeChromeTrace(const char *path);
+
+#endif
@@ -0,0 +1,355 @@
+#include "number_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FALLBACK_TOKEN_SIZE 128
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int readWholeStream(int fd, InputFile *input) {
+    size_t capacity = 1 << 16, size = 0;
+    char *buffer = malloc(capacity);
+    if (buffer == NULL) {
+        return -1;
+    }
+    for (;;) {
+        if (size == capacity) {
+            char *grown = realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, buffer + size, capacity - size);
+        if (n < 0) {
+            free(buffer);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        size += (size_t)n;
+    }
+    input->data = buffer;
+    input->size = size;
+    input->isMapped = 0;
+    return 0;
+}
+
+int openInputFile(const char *path, InputFile *input) {
+    int fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        int rc = readWholeStream(fd, input);
+        close(fd);
+        return rc;
+    }
+
+    input->data = NULL;
+    input->size = (size_t)st.st_size;
+    input->isMapped = 1;
+    if (input->size > 0) {
+        void *data = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(data, input->size, MADV_SEQUENTIAL);
+        input->data = data;
+    }
+    close(fd);
+    return 0;
+}
+
+void closeInputFile(InputFile *input) {
+    if (input->data != NULL) {
+        if (input->isMapped) {
+            munmap((void *)input->data, input->size);
+        } else {
+            free((void *)input->data);
+        }
+    }
+    input->data = NULL;
+    input->size = 0;
+}
+
+size_t alignToToken(const char *data, size_t size, size_t offset) {
+    if (offset == 0 || offset >= size) {
+        return offset < size ? offset : size;
+    }
+    while (offset < size && !isSpace(data[offset - 1])) {
+        offset++;
+    }
+    return offset;
+}
+
+size_t countTokens(const char *begin, const char *end) {
+    size_t tokens = 0;
+    int inToken = 0;
+    for (const char *p = begin; p < end; p++) {
+        int space = isSpace(*p);
+        tokens += !space && !inToken;
+        inToken = !space;
+    }
+    return tokens;
+}
+
+static int parseSlow(const char **cursor, const char *end, void *value, int elementType) {
+    char local[FALLBACK_TOKEN_SIZE];
+    const char *p = *cursor;
+    size_t length = 0;
+    while (p + length < end && !isSpace(p[length])) {
+        length++;
+    }
+
+    char *token = local;
+    if (length >= sizeof(local)) {
+        token = malloc(length + 1);
+        if (token == NULL) {
+            return 0;
+        }
+    }
+    memcpy(token, p, length);
+    token[length] = '\0';
+
+    char *stop;
+    if (elementType == ELEMENT_FLOAT64) {
+        *(double *)value = strtod(token, &stop);
+    } else {
+        *(float *)value = strtof(token, &stop);
+    }
+    size_t consumed = (size_t)(stop - token);
+    if (token != local) {
+        free(token);
+    }
+    if (consumed == 0) {
+        return 0;
+    }
+    *cursor = p + consumed;
+    return 1;
+}
+
+static int isFloatMidpoint(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return (bits & 0x1FFFFFFFull) == 0x10000000ull;
+}
+
+/*
+ * Fast path shared by both widths. Returns 1 with the magnitude in *value
+ * when the token is a plain decimal whose mantissa and power of ten are both
+ * exact doubles, so one multiply or divide rounds correctly; returns 0 when
+ * strtod/strtof has to decide.
+ */
+static int parseDecimal(const char *p, const char *end, int *negative, double *value, const char **next) {
+    *negative = 0;
+    if (*p == '+' || *p == '-') {
+        *negative = *p == '-';
+        p++;
+    }
+
+    const char *digitsStart = p;
+    uint64_t mantissa = 0;
+    int digits = 0, droppedDigits = 0, exponent = 0;
+    while (p < end && isDigit(*p)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            droppedDigits++;
+        }
+        p++;
+    }
+    int sawDigit = p > digitsStart;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isDigit(*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            } else {
+                droppedDigits++;
+            }
+            sawDigit = 1;
+            p++;
+        }
+    }
+    if (!sawDigit) {
+        return 0;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        int expNegative = 0;
+        if (e < end && (*e == '+' || *e == '-')) {
+            expNegative = *e == '-';
+            e++;
+        }
+        if (e == end || !isDigit(*e)) {
+            return 0;
+        }
+        int expValue = 0;
+        while (e < end && isDigit(*e)) {
+            if (expValue < 10000) {
+                expValue = expValue * 10 + (*e - '0');
+            }
+            e++;
+        }
+        exponent += expNegative ? -expValue : expValue;
+        p = e;
+    }
+
+    if (p < end && (*p == 'x' || *p == 'X')) {
+        return 0;
+    }
+
+    if (droppedDigits > 0 || mantissa > (1ull << 53) || exponent < -22 || exponent > 22) {
+        return 0;
+    }
+
+    double d = (double)mantissa;
+    *value = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+    *next = p;
+    return 1;
+}
+
+static const char *skipSpace(const char *p, const char *end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+int parseFloat(const char **cursor, const char *end, float *value) {
+    const char *p = skipSpace(*cursor, end);
+    *cursor = p;
+    if (p == end) {
+        return 0;
+    }
+
+    int negative;
+    double d;
+    if (!parseDecimal(p, end, &negative, &d, &p)
+        || (d != 0.0 && (d < FLT_MIN || d > FLT_MAX || isFloatMidpoint(d)))) {
+        return parseSlow(cursor, end, value, ELEMENT_FLOAT32);
+    }
+
+    *value = (float)(negative ? -d : d);
+    *cursor = p;
+    return 1;
+}
+
+int parseDouble(const char **cursor, const char *end, double *value) {
+    const char *p = skipSpace(*cursor, end);
+    *cursor = p;
+    if (p == end) {
+        return 0;
+    }
+
+    int negative;
+    double d;
+    if (!parseDecimal(p, end, &negative, &d, &p)) {
+        return parseSlow(cursor, end, value, ELEMENT_FLOAT64);
+    }
+
+    *value = negative ? -d : d;
+    *cursor = p;
+    return 1;
+}
+
+size_t parseNumbers(const char *begin, const char *end, float *numbers, size_t capacity, const char **stop) {
+    const char *cursor = begin;
+    size_t count = 0;
+    float value;
+    while (count < capacity && parseFloat(&cursor, end, &value)) {
+        numbers[count++] = value;
+    }
+    if (stop != NULL) {
+        *stop = cursor;
+    }
+    return count;
+}
+
+size_t parseDoubles(const char *begin, const char *end, double *numbers, size_t capacity, const char **stop) {
+    const char *cursor = begin;
+    size_t count = 0;
+    double value;
+    while (count < capacity && parseDouble(&cursor, end, &value)) {
+        numbers[count++] = value;
+    }
+    if (stop != NULL) {
+        *stop = cursor;
+    }
+    return count;
+}
+
+size_t parseElements(const char *begin, const char *end, void *numbers, int elementType, size_t capacity, const char **stop) {
+    if (elementType == ELEMENT_FLOAT64) {
+        return parseDoubles(begin, end, numbers, capacity, stop);
+    }
+    return parseNumbers(begin, end, numbers, capacity, stop);
+}
+
+/* Parses [begin, end) into a malloc'd buffer that grows as it fills. The
+ * token count is only a first guess: a token such as "1-2" holds two
+ * numbers. Returns NULL when memory runs out. */
+void *parseAllElements(const char *begin, const char *end, int elementType, size_t *count, const char **stop) {
+    size_t width = elementSize(elementType);
+    size_t capacity = countTokens(begin, end);
+    char *numbers = malloc((capacity > 0 ? capacity : 1) * width);
+    if (numbers == NULL) {
+        return NULL;
+    }
+    const char *cursor = begin;
+    *count = 0;
+    for (;;) {
+        size_t room = capacity - *count;
+        size_t parsed = parseElements(cursor, end, numbers + *count * width, elementType, room, &cursor);
+        *count += parsed;
+        if (parsed < room || countTokens(cursor, end) == 0) {
+            break;
+        }
+        capacity = capacity > 0 ? capacity * 2 : 1 << 16;
+        char *grown = realloc(numbers, capacity * width);
+        if (grown == NULL) {
+            free(numbers);
+            return NULL;
+        }
+        numbers = grown;
+    }
+    if (stop != NULL) {
+        *stop = cursor;
+    }
+    return numbers;
+}
@@ -0,0 +1,26 @@
+#ifndef NUMBER_PARSER_H
+#define NUMBER_PARSER_H
+
+#include <stddef.h>
+
+#include "element_type.h"
+
+typedef struct {
+    const char *data;
+    size_t size;
+    int isMapped;
+} InputFile;
+
+int openInputFile(const char *path, InputFile *input);
+void closeInputFile(InputFile *input);
+
+size_t alignToToken(const char *data, size_t size, size_t offset);
+size_t countTokens(const char *begin, const char *end);
+int parseFloat(const char **cursor, const char *end, float *value);
+int parseDouble(const char **cursor, const char *end, double *value);
+size_t parseNumbers(const char *begin, const char *end, float *numbers, size_t capacity, const char **stop);
+size_t parseDoubles(const char *begin, const char *end, double *numbers, size_t capacity, const char **stop);
+size_t parseElements(const char *begin, const char *end, void *numbers, int elementType, size_t capacity, const char **stop);
+void *parseAllElements(const char *begin, const char *end, int elementType, size_t *count, const char **stop);
+
+#endif
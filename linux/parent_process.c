@@ -1,39 +1,261 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <semaphore.h>
+#include <sys/resource.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "affinity.h"
+#include "async_reader.h"
+#include "batch.h"
+#include "binary_format.h"
+#include "common.h"
+#include "completion.h"
+#include "distributed.h"
+#include "incremental.h"
+#include "instrument.h"
+#include "number_parser.h"
+#include "pipe_protocol.h"
+#include "reduction.h"
+#include "shared_segment.h"
+#include "stream.h"
+#include "work_queue.h"
+#include "worker_pool.h"
 
 #define READ_END 0
 #define WRITE_END 1
+#define MIN_PARSE_CHUNK_BYTES 4096
+#define COMPLETION_POLL_MS 100
+#define MAX_BACKUP_CHILDREN 8
+#define STRAGGLER_FACTOR 4
+#define MIN_STRAGGLER_NS 200000000ull
+#define PIPE_BLOCKS_IN_FLIGHT 2
+#define BATCH_SEGMENT_BYTES ((size_t)256 << 20)
+#define BATCH_MAX_FILES 4096
+#define SEGMENT_SPEC_SIZE 48
 
-void executeWithSharedMemory(float *numbers, int count, int nChildren);
-void executeWithPipes(float *numbers, int count, int nChildren);
+typedef struct {
+    const char *numbers;
+    const ReductionSpec *spec;
+    WorkQueue *queue;
+    int index;
+    int nThreads;
+    WorkerStats stats;
+} ThreadTask;
 
-int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Incorrect usage. Expected format: %s <filename> <number_of_children> <ipc_method>\n", argv[0]);
-        exit(EXIT_FAILURE);
+/* Reductions chosen with --ops and the element type of the data; children
+ * get both in text form on their command line. */
+static const char *reductionOps = DEFAULT_REDUCTION_OPS;
+static ReductionSpec reduction;
+
+/* Reports asked for on the command line, printed once the run is over. */
+static int throughput;
+static int timings;
+static int showStats;
+static const char *statsJsonPath;
+static const char *tracePath;
+
+/* Sidecar cache for --incremental, NULL when it is off. */
+static const char *cachePath;
+
+/* Worker daemons for --nodes, NULL when the run is local. */
+static const char *nodeList;
+
+/* Text parsed by parseReady while --reader is still reading the rest of
+ * the file. Parsing stops for binary input and, like parseElements, at the
+ * first token that is not a number. */
+typedef struct {
+    int elementType;
+    int decided;
+    int binary;
+    int stopped;
+    char *numbers;
+    size_t count;
+    size_t capacity;
+    size_t parsed;
+} ReadParse;
+
+/* Blocks of a packed input segment that end at the given element offsets
+ * rather than every WORK_BLOCK_SIZE elements. Each block's partial is
+ * copied to partials once the children are done. */
+typedef struct {
+    const uint64_t *ends;
+    size_t blocks;
+    ReductionState *partials;
+} BlockLayout;
+
+void executeWithSharedMemory(const void *numbers, size_t count, int nChildren);
+void executeWithPipes(const void *numbers, size_t count, int nChildren);
+void executeWithMappedFile(const char *fileName, size_t dataOffset, size_t count, int nChildren);
+int runSharedMemoryChildren(const char *inputSpec, size_t count, int nChildren, const BlockLayout *layout, ReductionState *total);
+size_t executeWithParallelParse(const char *fileName, const InputFile *input, int nChildren);
+size_t executeBatch(const BatchList *list, int nChildren, int elementType, size_t *elements, size_t *bytes);
+int executeWithSegmentRead(const char *fileName, int nChildren, size_t *count);
+void executeWithThreads(const void *numbers, size_t count, int nThreads);
+static int reduceShard(const NodeShard *shard, const char *ops, const char *data, ReductionState *state, uint64_t *bytes);
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Incorrect usage. Expected format: %s <filename> <number_of_children> <ipc_method> [--parallel-parse | --stream | --incremental[=<cache>]] [--reader=mmap|uring|pread [--direct]] [--nodes=<host:port,...>] [--ops=<list>] [--element=float32|float64] [--throughput] [--timings] [--stats] [--stats-json=<file>] [--trace=<file>] [--transport=memfd|sysv] [--affinity=<policy>] [--huge-pages]\n", program);
+    fprintf(stderr, "       %s --serve=<socket_path> <number_of_workers> [--affinity=<policy>] [--huge-pages]\n", program);
+    fprintf(stderr, "       %s --submit=<socket_path> <filename> <number_of_children> <ipc_method>\n", program);
+    fprintf(stderr, "       %s --batch <number_of_children> shm <file|'<glob>'|@<manifest>>... [--ops=<list>] [--element=float32|float64] [--throughput] [--timings] [--stats]\n", program);
+    fprintf(stderr, "       %s --node=<host:port> <number_of_children> [--affinity=<policy>] [--huge-pages] [--transport=memfd|sysv]\n", program);
+}
+
+static double secondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void reportThroughput(const char *mode, size_t count, double seconds) {
+    double bytes = (double)count * (double)elementSize(reduction.elementType);
+    fprintf(stderr, "Throughput (%s, %s data, float64 accumulation): %zu elements, %.1f MB in %.3f s, %.2f GB/s\n",
+            mode, elementTypeName(reduction.elementType), count, bytes / 1e6, seconds,
+            seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+}
+
+/* One machine-readable line for bench.sh. Peak RSS of children covers only
+ * reaped ones, so it is printed after every worker has been waited for. */
+static void reportTimings(size_t count) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    fprintf(stderr, "Timings: wall=%.6f parse=%.6f transfer=%.6f spawn=%.6f compute=%.6f collect=%.6f elements=%zu bytes=%zu rss_kb=%ld child_rss_kb=%ld read_s=%.6f read_bytes=%llu\n",
+            wallSeconds(), phaseSeconds(PHASE_PARSE), phaseSeconds(PHASE_TRANSFER), phaseSeconds(PHASE_SPAWN),
+            phaseSeconds(PHASE_COMPUTE), phaseSeconds(PHASE_COLLECT), count, count * elementSize(reduction.elementType),
+            self.ru_maxrss, children.ru_maxrss, readerSeconds(), (unsigned long long)readerBytes());
+}
+
+static void reportRead(void) {
+    double seconds = readerSeconds();
+    double bytes = (double)readerBytes();
+    fprintf(stderr, "Read (%s): %.1f MB in %.3f s, %.2f GB/s\n", readerName(), bytes / 1e6, seconds,
+            seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+}
+
+static void finishReports(const char *mode, size_t count, double seconds) {
+    if (throughput) {
+        reportThroughput(mode, count, seconds);
+        if (inputReader() != READER_MMAP) {
+            reportRead();
+        }
     }
+    if (timings) {
+        reportTimings(count);
+    }
+    if (showStats) {
+        printStats(stderr);
+    }
+    if (statsJsonPath != NULL) {
+        writeStatsJson(statsJsonPath);
+    }
+    if (tracePath != NULL) {
+        writeChromeTrace(tracePath);
+    }
+}
 
+static int runIncremental(InputFile *input, const BinaryInfo *binary, int nThreads, const struct timespec *started) {
+    size_t processed;
+    uint64_t mark = monotonicNs();
+    int status = executeIncremental(input, binary, cachePath, &reduction, nThreads, &processed);
+    recordPhase("incremental reduce", PHASE_COMPUTE, mark);
+    closeInputFile(input);
+    if (status != 0) {
+        return EXIT_FAILURE;
+    }
+    finishReports("thread incremental, including parsing", processed, secondsSince(started));
+    return EXIT_SUCCESS;
+}
 
-    if (strcmp(argv[3], "shm") != 0 && strcmp(argv[3], "pipe") != 0) {
-        fprintf(stderr, "Invalid IPC method. Please use 'shm' for shared memory or 'pipe' for pipes.\n");
-        exit(EXIT_FAILURE);
+static int runDistributed(InputFile *input, const BinaryInfo *binary, int nChildren, const struct timespec *started) {
+    ReductionState total;
+    uint64_t mark = monotonicNs();
+    int status = executeDistributed(input, binary, nodeList, reductionOps, (int)reduction.elementType, nChildren, &total);
+    recordPhase("distribute shards", PHASE_COMPUTE, mark);
+    closeInputFile(input);
+    if (status != 0) {
+        return EXIT_FAILURE;
+    }
+    if (total.count < 2) {
+        fprintf(stderr, "The file must contain at least 2 numbers.\n");
+        return EXIT_FAILURE;
+    }
+    printReduction(&reduction, &total);
+    finishReports("distributed shm, including parsing", total.count, secondsSince(started));
+    return EXIT_SUCCESS;
+}
+
+static void parseReady(void *arg, const char *data, size_t size, size_t ready) {
+    ReadParse *parse = arg;
+    if (!parse->decided) {
+        if (ready < size && ready < BINARY_HEADER_SIZE) {
+            return;
+        }
+        parse->decided = 1;
+        parse->binary = isBinaryInput(data, ready);
+    }
+    if (parse->binary || parse->stopped) {
+        return;
+    }
+
+    /* Only up to the last separator, so no token is cut at a chunk edge. */
+    size_t end = ready;
+    if (ready < size) {
+        while (end > parse->parsed && !isspace((unsigned char)data[end - 1])) {
+            end--;
+        }
+    }
+    size_t width = elementSize(parse->elementType);
+    const char *cursor = data + parse->parsed;
+    const char *limit = data + end;
+    while (cursor < limit) {
+        if (parse->count == parse->capacity) {
+            size_t capacity = parse->capacity > 0 ? parse->capacity * 2 : 1 << 16;
+            char *grown = realloc(parse->numbers, capacity * width);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            parse->numbers = grown;
+            parse->capacity = capacity;
+        }
+        size_t room = parse->capacity - parse->count;
+        size_t parsed = parseElements(cursor, limit, parse->numbers + parse->count * width, parse->elementType, room, &cursor);
+        parse->count += parsed;
+        if (parsed < room) {
+            parse->stopped = cursor < limit;
+            break;
+        }
     }
+    parse->parsed = (size_t)(cursor - data);
+}
 
+static int clampChildren(size_t count, int nChildren) {
+    if ((size_t)nChildren > count / 2) {
+        nChildren = (int)(count / 2);
+        printf("Warning: Number of child processes adjusted to %d to match input size constraints.\n", nChildren);
+    }
+    return nChildren;
+}
+
+static int parseChildCount(const char *arg) {
     errno = 0; 
     char *end;
-    long nChildrenLong = strtol(argv[2], &end, 10);
-    if (end == argv[2] || *end != '\0' || errno == ERANGE) {
+    long nChildrenLong = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE) {
         if (errno == ERANGE)
             fprintf(stderr, "Error: The number of children is out of the allowed range.\n");
         else
@@ -44,220 +266,1502 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Error: The number of children must be a positive integer within the range of 1 to %d.\n", INT_MAX);
         exit(EXIT_FAILURE);
     }
-    int nChildren = (int)nChildrenLong;
+    return (int)nChildrenLong;
+}
 
-    FILE *file = fopen(argv[1], "r");
-    if (!file) {
-        perror("Unable to open the file");
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        {"parallel-parse", no_argument, NULL, 'P'},
+        {"serve", required_argument, NULL, 'S'},
+        {"submit", required_argument, NULL, 'J'},
+        {"affinity", required_argument, NULL, 'A'},
+        {"huge-pages", no_argument, NULL, 'H'},
+        {"stream", no_argument, NULL, 'T'},
+        {"ops", required_argument, NULL, 'O'},
+        {"element", required_argument, NULL, 'E'},
+        {"throughput", no_argument, NULL, 'R'},
+        {"timings", no_argument, NULL, 'M'},
+        {"stats", no_argument, NULL, 'I'},
+        {"stats-json", required_argument, NULL, 'N'},
+        {"trace", required_argument, NULL, 'C'},
+        {"transport", required_argument, NULL, 'G'},
+        {"incremental", optional_argument, NULL, 'K'},
+        {"reader", required_argument, NULL, 'U'},
+        {"direct", no_argument, NULL, 'D'},
+        {"node", required_argument, NULL, 'W'},
+        {"nodes", required_argument, NULL, 'Y'},
+        {"batch", no_argument, NULL, 'B'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int parallelParse = 0;
+    int batch = 0;
+    int incremental = 0;
+    int direct = 0;
+    int stream = 0;
+    int elementType = ELEMENT_FLOAT32;
+    instrumentStart();
+    const char *serveSocket = NULL;
+    const char *submitSocket = NULL;
+    const char *nodeAddress = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'P':
+            parallelParse = 1;
+            break;
+        case 'S':
+            serveSocket = optarg;
+            break;
+        case 'J':
+            submitSocket = optarg;
+            break;
+        case 'H':
+            setHugePages(1);
+            break;
+        case 'T':
+            stream = 1;
+            break;
+        case 'O':
+            reductionOps = optarg;
+            break;
+        case 'E':
+            elementType = parseElementType(optarg);
+            if (elementType == -1) {
+                fprintf(stderr, "Invalid element type '%s'. Please use 'float32' or 'float64'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'R':
+            throughput = 1;
+            break;
+        case 'M':
+            timings = 1;
+            break;
+        case 'I':
+            showStats = 1;
+            break;
+        case 'N':
+            statsJsonPath = optarg;
+            break;
+        case 'C':
+            tracePath = optarg;
+            break;
+        case 'K':
+            incremental = 1;
+            cachePath = optarg;
+            break;
+        case 'U':
+            if (setInputReader(optarg) != 0) {
+                fprintf(stderr, "Invalid reader '%s'. Please use 'mmap', 'uring' or 'pread'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            direct = 1;
+            setDirectReads(1);
+            break;
+        case 'W':
+            nodeAddress = optarg;
+            break;
+        case 'Y':
+            nodeList = optarg;
+            break;
+        case 'B':
+            batch = 1;
+            break;
+        case 'G':
+            if (setSegmentTransport(optarg) != 0) {
+                fprintf(stderr, "Invalid transport '%s'. Please use 'memfd' or 'sysv'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            if (setAffinityPolicy(optarg) != 0) {
+                fprintf(stderr, "Invalid affinity policy '%s'. Please use 'none', 'compact', 'scatter' or 'per-node'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (serveSocket != NULL) {
+        if (argc - optind != 1 || submitSocket != NULL || parallelParse || stream) {
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        return runServer(serveSocket, parseChildCount(argv[optind]));
+    }
+    if (nodeAddress != NULL) {
+        if (argc - optind != 1 || submitSocket != NULL || nodeList != NULL || parallelParse || stream) {
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        return runNode(nodeAddress, parseChildCount(argv[optind]), reduceShard);
+    }
+    if (batch) {
+        if (argc - optind < 3 || serveSocket != NULL || submitSocket != NULL || nodeList != NULL) {
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[optind + 1], "shm") != 0 || parallelParse || stream || incremental || inputReader() != READER_MMAP) {
+            fprintf(stderr, "Error: --batch is only supported with the 'shm' method and without --parallel-parse, --stream, --incremental or --reader.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (parseReductionSpec(reductionOps, elementType, &reduction) != 0) {
+            fprintf(stderr, "Invalid reduction list '%s'. Please use a comma-separated list of sum, sumsq, mean, var, min, max, l2 and hist:<low>:<high>[:<bins>].\n", reductionOps);
+            exit(EXIT_FAILURE);
+        }
+        int nChildren = parseChildCount(argv[optind]);
+        BatchList list;
+        if (collectBatchInputs(argv + optind + 2, argc - optind - 2, &list) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        struct timespec started;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        size_t elements, bytes;
+        size_t failed = executeBatch(&list, nChildren, elementType, &elements, &bytes);
+        double seconds = secondsSince(&started);
+        printf("Batch: %zu files, %zu failed, %zu elements in %.3f s (%.2f M elements/s, %.3f GB/s)\n", list.count, failed,
+               elements, seconds, seconds > 0 ? elements / seconds / 1e6 : 0.0, seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+        finishReports("shm batch, including parsing", elements, seconds);
+        freeBatchList(&list);
+        return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (argc - optind != 3) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (parseReductionSpec(reductionOps, elementType, &reduction) != 0) {
+        fprintf(stderr, "Invalid reduction list '%s'. Please use a comma-separated list of sum, sumsq, mean, var, min, max, l2 and hist:<low>:<high>[:<bins>].\n", reductionOps);
         exit(EXIT_FAILURE);
     }
 
-    float *numbers = malloc(sizeof(float));
-    if (numbers == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
+    const char *fileName = argv[optind];
+    const char *childrenArg = argv[optind + 1];
+    const char *ipcMethod = argv[optind + 2];
+
+    if (strcmp(ipcMethod, "shm") != 0 && strcmp(ipcMethod, "pipe") != 0 && strcmp(ipcMethod, "thread") != 0) {
+        fprintf(stderr, "Invalid IPC method. Please use 'shm' for shared memory, 'pipe' for pipes or 'thread' for threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (parallelParse && strcmp(ipcMethod, "shm") != 0) {
+        fprintf(stderr, "Error: --parallel-parse is only supported with the 'shm' method.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (stream && (parallelParse || strcmp(ipcMethod, "shm") != 0)) {
+        fprintf(stderr, "Error: --stream is only supported with the 'shm' method and without --parallel-parse.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (inputReader() != READER_MMAP && (parallelParse || stream)) {
+        fprintf(stderr, "Error: --reader cannot be combined with --parallel-parse or --stream, which read the input in the workers.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (direct && inputReader() == READER_MMAP) {
+        fprintf(stderr, "Error: --direct needs --reader=uring or --reader=pread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nodeList != NULL && (strcmp(ipcMethod, "shm") != 0 || parallelParse || stream || incremental || inputReader() != READER_MMAP)) {
+        fprintf(stderr, "Error: --nodes is only supported with the 'shm' method and without --parallel-parse, --stream, --incremental or --reader.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (incremental && strcmp(ipcMethod, "thread") != 0) {
+        fprintf(stderr, "Error: --incremental is only supported with the 'thread' method.\n");
+        exit(EXIT_FAILURE);
+    }
+    char *defaultCachePath = NULL;
+    if (incremental && cachePath == NULL) {
+        size_t length = strlen(fileName) + sizeof(".sqcache");
+        defaultCachePath = malloc(length);
+        if (defaultCachePath == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(defaultCachePath, length, "%s.sqcache", fileName);
+        cachePath = defaultCachePath;
+    }
+
+    int nChildren = parseChildCount(childrenArg);
+
+    if (submitSocket != NULL) {
+        if (parallelParse || stream || incremental || nodeList != NULL || inputReader() != READER_MMAP || timings || showStats || statsJsonPath != NULL || tracePath != NULL
+            || strcmp(reductionOps, DEFAULT_REDUCTION_OPS) != 0 || elementType != ELEMENT_FLOAT32) {
+            fprintf(stderr, "Error: --parallel-parse, --stream, --incremental, --nodes, --reader, --ops, --element and the timing and stats reports cannot be combined with --submit.\n");
+            exit(EXIT_FAILURE);
+        }
+        return submitJob(submitSocket, fileName, nChildren, ipcMethod);
+    }
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (stream) {
+        size_t streamed;
+        if (executeStreaming(fileName, nChildren, &reduction, &streamed) != 0) {
+            return EXIT_FAILURE;
+        }
+        finishReports("shm stream, including input", streamed, secondsSince(&started));
+        return EXIT_SUCCESS;
+    }
+
+    if (inputReader() != READER_MMAP && strcmp(ipcMethod, "shm") == 0 && cachePath == NULL) {
+        size_t loaded;
+        if (executeWithSegmentRead(fileName, nChildren, &loaded) == 0) {
+            finishReports("shm, including reading", loaded, secondsSince(&started));
+            return EXIT_SUCCESS;
+        }
+    }
+
+    uint64_t mark = monotonicNs();
+    InputFile input;
+    ReadParse parse = { (int)reduction.elementType, 0, 0, 0, NULL, 0, 0, 0 };
+    int opened = inputReader() == READER_MMAP ? openInputFile(fileName, &input)
+        : readInputFile(fileName, &input, cachePath == NULL ? parseReady : NULL, &parse);
+    if (opened != 0) {
+        perror("Unable to open the file");
         exit(EXIT_FAILURE);
     }
-    int count = 0, capacity = 1;
-    float num;
-    while (fscanf(file, "%f", &num) == 1) {
-        if (count >= capacity) {
-            capacity *= 2;
-            numbers = realloc(numbers, capacity * sizeof(float));
+
+    char *numbers = NULL;
+    size_t count = 0;
+    int ownsNumbers = 1;
+    int mapDirectly = 0;
+    BinaryInfo binary;
+
+    if (isBinaryInput(input.data, input.size)) {
+        const char *error;
+        if (readBinaryHeader(input.data, input.size, &binary, &error) != 0) {
+            fprintf(stderr, "Invalid binary input: %s.\n", error);
+            closeInputFile(&input);
+            exit(EXIT_FAILURE);
+        }
+        count = binary.count;
+        reduction.elementType = (uint32_t)binary.elementType;
+        if (cachePath != NULL) {
+            return runIncremental(&input, &binary, nChildren, &started);
+        }
+        if (nodeList != NULL) {
+            return runDistributed(&input, &binary, nChildren, &started);
+        }
+        if (binary.swapped) {
+            numbers = malloc((count > 0 ? count : 1) * elementSize(binary.elementType));
             if (numbers == NULL) {
-                fprintf(stderr, "Memory reallocation failed\n");
-                fclose(file);
+                fprintf(stderr, "Memory allocation failed\n");
+                closeInputFile(&input);
                 exit(EXIT_FAILURE);
             }
+            swapElements(numbers, input.data + binary.dataOffset, count, binary.elementType);
+        } else {
+            numbers = (char *)(input.data + binary.dataOffset);
+            ownsNumbers = 0;
+            mapDirectly = input.isMapped;
         }
-        numbers[count++] = num;
+    } else {
+        if (cachePath != NULL) {
+            return runIncremental(&input, NULL, nChildren, &started);
+        }
+        if (nodeList != NULL) {
+            return runDistributed(&input, NULL, nChildren, &started);
+        }
+        if (parallelParse) {
+            if (input.isMapped) {
+                size_t parsed = executeWithParallelParse(fileName, &input, nChildren);
+                finishReports("shm parallel-parse, including parsing", parsed, secondsSince(&started));
+                closeInputFile(&input);
+                return 0;
+            }
+            fprintf(stderr, "Warning: %s is not a regular file, parsing it in the parent instead.\n", fileName);
+        }
+
+        if (parse.decided) {
+            numbers = parse.numbers;
+            count = parse.count;
+        } else {
+            numbers = parseAllElements(input.data, input.data + input.size, reduction.elementType, &count, NULL);
+            if (numbers == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                closeInputFile(&input);
+                exit(EXIT_FAILURE);
+            }
+        }
+        closeInputFile(&input);
     }
-    fclose(file);
 
     if (count < 2) {
         fprintf(stderr, "The file must contain at least 2 numbers.\n");
-        free(numbers);
+        if (ownsNumbers) {
+            free(numbers);
+        }
+        closeInputFile(&input);
         exit(EXIT_FAILURE);
     }
 
-    if (nChildren > count / 2) {
-        nChildren = count / 2;
-        printf("Warning: Number of child processes adjusted to %d to match input size constraints.\n", nChildren);
-    }
+    nChildren = clampChildren(count, nChildren);
 
-    if (strcmp(argv[3], "shm") == 0) {
-        executeWithSharedMemory(numbers, count, nChildren);
-    } else if (strcmp(argv[3], "pipe") == 0) {
+    recordPhase("read input", PHASE_PARSE, mark);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (strcmp(ipcMethod, "shm") == 0) {
+        if (mapDirectly) {
+            executeWithMappedFile(fileName, binary.dataOffset, count, nChildren);
+        } else {
+            executeWithSharedMemory(numbers, count, nChildren);
+        }
+    } else if (strcmp(ipcMethod, "pipe") == 0) {
         executeWithPipes(numbers, count, nChildren);
+    } else if (strcmp(ipcMethod, "thread") == 0) {
+        executeWithThreads(numbers, count, nChildren);
     } else {
-        fprintf(stderr, "Invalid IPC method. Please use 'shm' for shared memory or 'pipe' for pipes.\n");
-        free(numbers);
+        fprintf(stderr, "Invalid IPC method. Please use 'shm' for shared memory, 'pipe' for pipes or 'thread' for threads.\n");
+        if (ownsNumbers) {
+            free(numbers);
+        }
+        closeInputFile(&input);
         exit(EXIT_FAILURE);
     }
+    finishReports(ipcMethod, count, secondsSince(&started));
 
-    free(numbers);
+    if (ownsNumbers) {
+        free(numbers);
+    }
+    closeInputFile(&input);
     return 0;
 }
 
 
-void executeWithSharedMemory(float *numbers, int count, int nChildren) {
-    int shmID = shmget(IPC_PRIVATE, count * sizeof(float), IPC_CREAT | 0666);
-    if (shmID == -1) {
-        perror("shmget failed");
+/* With --affinity the segment's pages are placed across the nodes of the
+ * nWorkers children that claim its blocks, before anything touches them.
+ * The elements start prefix bytes into the segment. */
+static void createInputSegment(SharedSegment *segment, size_t prefix, size_t count, int nWorkers) {
+    uint64_t mark = monotonicNs();
+    size_t width = elementSize(reduction.elementType);
+    if (createSegment(segment, prefix + count * width, "Input") != 0) {
+        perror("Unable to create the input segment");
         exit(EXIT_FAILURE);
     }
+    interleaveOverWorkers((char *)segment->base + prefix, count * width, nWorkers);
+    recordPhase("create input segment", PHASE_TRANSFER, mark);
+}
 
-    float *shmPtr = (float *)shmat(shmID, NULL, 0);
-    if (shmPtr == (void *)-1) {
-        perror("shmat failed");
-        shmctl(shmID, IPC_RMID, NULL);
-        exit(EXIT_FAILURE);
+static int runInputSegment(SharedSegment *segment, size_t prefix, size_t count, int nChildren, const BlockLayout *layout, ReductionState *total) {
+    if (sealSegment(segment) != 0) {
+        perror("Warning: unable to seal the input segment");
     }
-    memcpy(shmPtr, numbers, count * sizeof(float));
 
-    int shmIDResult = shmget(IPC_PRIVATE, nChildren * sizeof(float), IPC_CREAT | 0666);
-    if (shmIDResult == -1) {
-        perror("shmget failed for result");
-        shmdt(shmPtr);
-        shmctl(shmID, IPC_RMID, NULL);
+    char inputSpec[SEGMENT_SPEC_SIZE];
+    segmentSpec(segment, inputSpec, sizeof(inputSpec));
+    if (prefix > 0) {
+        snprintf(inputSpec + strlen(inputSpec), sizeof(inputSpec) - strlen(inputSpec), "+%zu", prefix);
+    }
+    inheritSegment(segment);
+    int status = runSharedMemoryChildren(inputSpec, count, nChildren, layout, total);
+    destroySegment(segment);
+    return status;
+}
+
+void executeWithSharedMemory(const void *numbers, size_t count, int nChildren) {
+    SharedSegment segment;
+    createInputSegment(&segment, 0, count, nChildren);
+    uint64_t mark = monotonicNs();
+    memcpy(segment.base, numbers, count * elementSize(reduction.elementType));
+    recordPhase("copy input", PHASE_TRANSFER, mark);
+    if (runInputSegment(&segment, 0, count, nChildren, NULL, NULL) != 0) {
         exit(EXIT_FAILURE);
     }
+}
 
-    float *resultPtr = (float *)shmat(shmIDResult, NULL, 0);
-    if (resultPtr == (void *)-1) {
-        perror("shmat failed for result");
-        shmdt(shmPtr);
-        shmctl(shmID, IPC_RMID, NULL);
-        shmctl(shmIDResult, IPC_RMID, NULL);
+/* Reduces one shard sent by a --nodes coordinator with this node's own
+ * children, the same way the shm method runs over a whole file. */
+static int reduceShard(const NodeShard *shard, const char *ops, const char *data, ReductionState *state, uint64_t *bytes) {
+    if (parseReductionSpec(ops, (int)shard->elementType, &reduction) != 0) {
+        fprintf(stderr, "Invalid reduction list '%s' in shard %llu.\n", ops, (unsigned long long)shard->index);
+        return -1;
+    }
+    size_t width = elementSize(reduction.elementType);
+    if (shard->binary && shard->length % width != 0) {
+        fprintf(stderr, "Shard %llu does not hold whole elements.\n", (unsigned long long)shard->index);
+        return -1;
+    }
+    size_t count = shard->length / width;
+    void *parsed = NULL;
+    *bytes = shard->length;
+    if (!shard->binary) {
+        const char *stop;
+        parsed = parseAllElements(data, data + shard->length, reduction.elementType, &count, &stop);
+        if (parsed == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        if (countTokens(stop, data + shard->length) > 0) {
+            *bytes = (uint64_t)(stop - data);
+        }
+    }
+    int nChildren = (size_t)shard->children > count / 2 ? (int)(count / 2) : (int)shard->children;
+
+    SharedSegment segment;
+    char few[2 * sizeof(double)];
+    char *numbers = few;
+    if (count >= 2) {
+        createInputSegment(&segment, 0, count, nChildren);
+        numbers = segment.base;
+    }
+    if (parsed != NULL) {
+        memcpy(numbers, parsed, count * width);
+        free(parsed);
+    } else if (shard->swapped) {
+        swapElements(numbers, data, count, reduction.elementType);
+    } else {
+        memcpy(numbers, data, count * width);
+    }
+
+    reductionOps = ops;
+    int status = 0;
+    if (count < 2) {
+        reduceRange(&reduction, numbers, count, state);
+    } else {
+        status = runInputSegment(&segment, 0, count, nChildren, NULL, state);
+    }
+    reductionOps = DEFAULT_REDUCTION_OPS;
+    return status;
+}
+
+/* Native-order binary input read by --reader straight into the input
+ * segment, so the parent never holds a copy of its own. Returns 1, having
+ * read only the header, when the file has to take the usual path. */
+int executeWithSegmentRead(const char *fileName, int nChildren, size_t *count) {
+    int fd = openForReading(fileName);
+    if (fd == -1) {
+        return 1;
+    }
+    struct stat st;
+    char header[BINARY_HEADER_SIZE];
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(header)
+        || readFileInto(fd, 0, sizeof(header), header, NULL, NULL) != 0 || !isBinaryInput(header, sizeof(header))) {
+        close(fd);
+        return 1;
+    }
+    BinaryInfo binary;
+    const char *error;
+    if (readBinaryHeader(header, (size_t)st.st_size, &binary, &error) != 0) {
+        fprintf(stderr, "Invalid binary input: %s.\n", error);
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    if (binary.swapped) {
+        close(fd);
+        return 1;
+    }
+    if (binary.count < 2) {
+        fprintf(stderr, "The file must contain at least 2 numbers.\n");
+        close(fd);
         exit(EXIT_FAILURE);
     }
 
-    sem_unlink("/semaphore");
-    sem_t *sem = sem_open("/semaphore", O_CREAT | O_EXCL, 0644, 1);
-    if (sem == SEM_FAILED) {
-        perror("sem_open failed");
-        shmdt(shmPtr);
-        shmdt(resultPtr);
-        shmctl(shmID, IPC_RMID, NULL);
-        shmctl(shmIDResult, IPC_RMID, NULL);
+    reduction.elementType = (uint32_t)binary.elementType;
+    nChildren = clampChildren(binary.count, nChildren);
+    /* Direct reads need an aligned file offset, so the read starts at the
+     * aligned offset below the data and the segment keeps the part of the
+     * header in between as a prefix that children skip. */
+    size_t prefix = binary.dataOffset % DIRECT_ALIGNMENT;
+    SharedSegment segment;
+    createInputSegment(&segment, prefix, binary.count, nChildren);
+    uint64_t mark = monotonicNs();
+    if (readFileInto(fd, binary.dataOffset - prefix, prefix + binary.count * elementSize(binary.elementType), segment.base, NULL, NULL) != 0) {
+        perror("Unable to read the file");
+        destroySegment(&segment);
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    recordPhase("read input into segment", PHASE_TRANSFER, mark);
+    if (runInputSegment(&segment, prefix, binary.count, nChildren, NULL, NULL) != 0) {
         exit(EXIT_FAILURE);
     }
+    *count = binary.count;
+    return 0;
+}
 
-    for (int i = 0; i < nChildren; i++) {
-        pid_t pid = fork();
-        if (pid == 0) {
-            char shmIDStr[20], shmIDResultStr[20], childIndexStr[20], nChildrenStr[20], countStr[20];
-            sprintf(shmIDStr, "%d", shmID);
-            sprintf(shmIDResultStr, "%d", shmIDResult);
-            sprintf(childIndexStr, "%d", i);
-            sprintf(nChildrenStr, "%d", nChildren);
-            sprintf(countStr, "%d", count);
-            execl("./child_process", "child_process", "shm", shmIDStr, shmIDResultStr, childIndexStr, nChildrenStr, countStr, (char *)NULL);
-            perror("execl failed");
+
+/* One input of a --batch run, open from when its group is planned until it
+ * is packed into the group's segment. Text is parsed as soon as the file is
+ * opened, since only parsing tells how many numbers it holds. */
+typedef struct {
+    InputFile input;
+    BinaryInfo binary;
+    void *parsed;
+    int opened;
+    int failed;
+    int isBinary;
+    int elementType;
+    size_t capacity;
+    size_t count;
+    size_t firstBlock;
+    size_t blocks;
+} BatchFile;
+
+static int openBatchFile(const char *path, int elementType, BatchFile *file) {
+    const char *error;
+    memset(file, 0, sizeof(*file));
+    if (openInputFile(path, &file->input) != 0) {
+        fprintf(stderr, "%s: Unable to open the file: %s\n", path, strerror(errno));
+        file->failed = 1;
+        return -1;
+    }
+    file->opened = 1;
+    file->elementType = elementType;
+    if (isBinaryInput(file->input.data, file->input.size)) {
+        if (readBinaryHeader(file->input.data, file->input.size, &file->binary, &error) != 0) {
+            fprintf(stderr, "%s: Invalid binary input: %s.\n", path, error);
+            closeInputFile(&file->input);
+            file->opened = 0;
+            file->failed = 1;
+            return -1;
+        }
+        file->isBinary = 1;
+        file->elementType = file->binary.elementType;
+        file->capacity = file->binary.count;
+    } else {
+        file->parsed = parseAllElements(file->input.data, file->input.data + file->input.size, elementType, &file->capacity, NULL);
+        if (file->parsed == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
             exit(EXIT_FAILURE);
         }
+        closeInputFile(&file->input);
     }
+    return 0;
+}
 
-    for (int i = 0; i < nChildren; i++) {
-        wait(NULL);
+/* Packs the open files of one group into a single input segment, one run of
+ * blocks per file so no block mixes two files, and reduces it with one set
+ * of children. Prints each file's result in order. */
+static void runBatchGroup(const BatchList *list, BatchFile *files, size_t first, size_t last, int nChildren, size_t *elements) {
+    size_t capacity = 0, planned = 0;
+    for (size_t i = first; i < last; i++) {
+        capacity += files[i].opened ? files[i].capacity : 0;
+        planned += files[i].opened && files[i].capacity >= 2 ? (files[i].capacity + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE : 0;
+    }
+    SharedSegment segment;
+    char *base = NULL;
+    if (capacity >= 2) {
+        createInputSegment(&segment, 0, capacity, (size_t)nChildren > planned ? (int)planned : nChildren);
+        base = segment.base;
     }
 
-    double totalSum = 0;
-    for (int i = 0; i < nChildren; i++) {
-        totalSum += resultPtr[i];
+    uint64_t mark = monotonicNs();
+    size_t width = elementSize(reduction.elementType), packed = 0, blocks = 0;
+    for (size_t i = first; i < last; i++) {
+        BatchFile *file = &files[i];
+        if (!file->opened) {
+            continue;
+        }
+        char *numbers = base != NULL ? base + packed * width : NULL;
+        if (numbers == NULL) {
+            file->count = 0;
+        } else if (!file->isBinary) {
+            file->count = file->capacity;
+            memcpy(numbers, file->parsed, file->count * width);
+        } else if (file->binary.swapped) {
+            file->count = file->binary.count;
+            swapElements(numbers, file->input.data + file->binary.dataOffset, file->count, file->elementType);
+        } else {
+            file->count = file->binary.count;
+            memcpy(numbers, file->input.data + file->binary.dataOffset, file->count * width);
+        }
+        closeInputFile(&file->input);
+        free(file->parsed);
+        file->parsed = NULL;
+        file->opened = 0;
+        if (file->count < 2) {
+            fprintf(stderr, "%s: The file must contain at least 2 numbers.\n", list->paths[i]);
+            file->failed = 1;
+            continue;
+        }
+        file->firstBlock = blocks;
+        file->blocks = (file->count + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE;
+        blocks += file->blocks;
+        packed += file->count;
+    }
+    recordPhase("pack batch", PHASE_TRANSFER, mark);
+    if (blocks == 0) {
+        if (base != NULL) {
+            destroySegment(&segment);
+        }
+        return;
+    }
+
+    uint64_t *ends = malloc(blocks * sizeof(uint64_t));
+    ReductionState *partials = malloc(blocks * sizeof(ReductionState));
+    if (ends == NULL || partials == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t offset = 0;
+    for (size_t i = first; i < last; i++) {
+        for (size_t b = 0; !files[i].failed && b < files[i].blocks; b++) {
+            ends[files[i].firstBlock + b] = offset + (b + 1 < files[i].blocks ? (b + 1) * WORK_BLOCK_SIZE : files[i].count);
+        }
+        offset += files[i].failed ? 0 : files[i].count;
+    }
+
+    BlockLayout layout = { ends, blocks, partials };
+    int workers = (size_t)nChildren > blocks ? (int)blocks : nChildren;
+    ReductionState groupTotal;
+    int status = runInputSegment(&segment, 0, packed, workers, &layout, &groupTotal);
+    for (size_t i = first; i < last && status == 0; i++) {
+        if (files[i].failed) {
+            continue;
+        }
+        ReductionState total;
+        reductionInit(&total);
+        for (size_t b = 0; b < files[i].blocks; b++) {
+            reductionMerge(&total, &partials[files[i].firstBlock + b]);
+        }
+        printf("%s:\n", list->paths[i]);
+        printReduction(&reduction, &total);
+        *elements += files[i].count;
+    }
+    if (status != 0) {
+        for (size_t i = first; i < last; i++) {
+            files[i].failed = 1;
+        }
+    }
+    free(ends);
+    free(partials);
+}
+
+/*
+ * Reduces every file of a --batch run. Files are opened in order and
+ * grouped until a group would pass BATCH_SEGMENT_BYTES or its element type
+ * changes, so a run of small files shares one segment and one set of
+ * children instead of paying for both per file, and is never clamped to
+ * its own size. Returns the number of files that could not be reduced.
+ */
+size_t executeBatch(const BatchList *list, int nChildren, int elementType, size_t *elements, size_t *bytes) {
+    BatchFile *files = calloc(list->count, sizeof(BatchFile));
+    if (files == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *elements = 0;
+    *bytes = 0;
+    size_t next = 0;
+    while (next < list->count) {
+        uint64_t mark = monotonicNs();
+        size_t first = next, groupBytes = 0;
+        int groupType = -1;
+        for (; next < list->count && next - first < BATCH_MAX_FILES; next++) {
+            BatchFile *file = &files[next];
+            if (!file->opened && openBatchFile(list->paths[next], elementType, file) != 0) {
+                continue;
+            }
+            size_t fileBytes = file->capacity * elementSize(file->elementType);
+            if (groupType != -1 && (file->elementType != groupType || groupBytes + fileBytes > BATCH_SEGMENT_BYTES)) {
+                break;
+            }
+            groupType = file->elementType;
+            groupBytes += fileBytes;
+        }
+        recordPhase("open batch files", PHASE_PARSE, mark);
+
+        size_t before = *elements;
+        reduction.elementType = (uint32_t)(groupType != -1 ? groupType : elementType);
+        runBatchGroup(list, files, first, next, nChildren, elements);
+        *bytes += (*elements - before) * elementSize(reduction.elementType);
     }
-    printf("Total sum of squares: %f\n", totalSum);
 
-    shmdt(shmPtr);
-    shmdt(resultPtr);
-    shmctl(shmID, IPC_RMID, NULL);
-    shmctl(shmIDResult, IPC_RMID, NULL);
-    sem_close(sem);
-    sem_unlink("/semaphore");
+    size_t failed = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        failed += files[i].failed;
+    }
+    free(files);
+    return failed;
 }
 
 
+void executeWithMappedFile(const char *fileName, size_t dataOffset, size_t count, int nChildren) {
+    size_t specSize = strlen(fileName) + 48;
+    char *inputSpec = malloc(specSize);
+    if (inputSpec == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(inputSpec, specSize, "file:%zu:%s", dataOffset, fileName);
+    int status = runSharedMemoryChildren(inputSpec, count, nChildren, NULL, NULL);
+    free(inputSpec);
+    if (status != 0) {
+        exit(EXIT_FAILURE);
+    }
+}
 
-void executeWithPipes(float *numbers, int count, int nChildren) {
-    int segmentSize = count / nChildren;
-    int remainder = count % nChildren;
-    double totalSum = 0;
 
-    int **pipes = malloc(nChildren * sizeof(int*));
-    int **resultPipes = malloc(nChildren * sizeof(int*));
-    for (int i = 0; i < nChildren; i++) {
-        pipes[i] = malloc(2 * sizeof(int));
-        resultPipes[i] = malloc(2 * sizeof(int));
-
-        if (pipe(pipes[i]) != 0 || pipe(resultPipes[i]) != 0) {
-            perror("pipe failed");
-            for (int j = 0; j <= i; j++) {
-                free(pipes[j]);
-                free(resultPipes[j]);
+/* Blocks on the segment's futex until every child has published its slot.
+ * While waiting it polls for children that exited without publishing, so a
+ * crashed child ends the wait instead of hanging it. Reaped pids are zeroed. */
+static int awaitCompletion(ResultSegment *segment, pid_t *pids, int nChildren) {
+    while (completionWait(&segment->completion, COMPLETION_POLL_MS) != 0) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < nChildren; i++) {
+                if (pids[i] == pid) {
+                    pids[i] = 0;
+                    if (!resultReady(&segment->slots[i])) {
+                        fprintf(stderr, "Child process %d exited without reporting a result.\n", i);
+                        return -1;
+                    }
+                }
             }
-            free(pipes);
-            free(resultPipes);
-            exit(EXIT_FAILURE);
         }
     }
+    return 0;
+}
 
+static void reapChildren(pid_t *pids, int nChildren) {
     for (int i = 0; i < nChildren; i++) {
-        pid_t pid = fork();
-        if (pid == 0) {
-            for (int j = 0; j < nChildren; j++) {
-                if (j != i) {
-                    close(pipes[j][READ_END]);
-                    close(pipes[j][WRITE_END]);
-                    close(resultPipes[j][READ_END]);
-                    close(resultPipes[j][WRITE_END]);
+        if (pids[i] > 0) {
+            waitpid(pids[i], NULL, 0);
+            pids[i] = 0;
+        }
+    }
+}
+
+/* Names how a child ended for the messages about replacing it. */
+static const char *describeExit(int status, char *text, size_t size) {
+    if (WIFSIGNALED(status)) {
+        snprintf(text, size, "killed by signal %d", WTERMSIG(status));
+    } else {
+        snprintf(text, size, "exit status %d", WEXITSTATUS(status));
+    }
+    return text;
+}
+
+static uint64_t stragglerLimit(uint64_t meanNs) {
+    return meanNs * STRAGGLER_FACTOR > MIN_STRAGGLER_NS ? meanNs * STRAGGLER_FACTOR : MIN_STRAGGLER_NS;
+}
+
+/* The children of one shm run. Slots past nChildren belong to backups. */
+typedef struct {
+    const char *inputSpec;
+    char resultSpec[SEGMENT_SPEC_SIZE];
+    size_t count;
+    int nChildren;
+    int nSlots;
+    int nWorkers;
+    pid_t *pids;
+    uint64_t *backedUp;
+    ResultSegment *segment;
+    WorkQueue *queue;
+} ShmRun;
+
+/* Starts worker nWorkers. Backups are left unpinned, so they do not queue
+ * behind the straggler on its core; redo is the block a backup takes over,
+ * or -1 to only claim fresh blocks. */
+static int spawnShmChild(ShmRun *run, long redo) {
+    if (run->nWorkers == run->nSlots) {
+        return -1;
+    }
+    int index = run->nWorkers;
+    pid_t pid = fork();
+    if (pid == 0) {
+        char childIndexStr[20], nSlotsStr[20], countStr[24], redoStr[24];
+        sprintf(childIndexStr, "%d", index);
+        sprintf(nSlotsStr, "%d", run->nSlots);
+        sprintf(countStr, "%zu", run->count);
+        sprintf(redoStr, "%ld", redo);
+        if (index < run->nChildren) {
+            pinWorker(index, run->nChildren);
+        }
+        execl("./child_process", "child_process", "shm", run->inputSpec, run->resultSpec, childIndexStr, nSlotsStr, countStr,
+              reductionOps, elementTypeName(reduction.elementType), redo >= 0 ? redoStr : (char *)NULL, (char *)NULL);
+        perror("execl failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    run->pids[index] = pid;
+    run->nWorkers++;
+    return 0;
+}
+
+/* A child that died abnormally may have left its block unfinished, and
+ * unclaimed blocks nobody else may live to take; a backup covers both.
+ * Only a child killed by a signal, or one that got as far as its blocks,
+ * is replaced: one that failed on its own before any work, such as a
+ * failed exec, would fail the same way in every backup. */
+static int replaceChild(ShmRun *run, int index, int status) {
+    char reason[48];
+    WorkerProgress *progress = &run->segment->slots[index].progress;
+    uint64_t block = atomic_load_explicit(&progress->block, memory_order_acquire);
+    if (!WIFSIGNALED(status) && block == 0 && atomic_load_explicit(&progress->blocks, memory_order_acquire) == 0) {
+        fprintf(stderr, "Child process %d failed (%s) before reducing any block.\n", index, describeExit(status, reason, sizeof(reason)));
+        return -1;
+    }
+    long redo = block > 0 && !blockFinished(run->queue, block - 1) ? (long)(block - 1) : -1;
+    fprintf(stderr, "Child process %d failed (%s), recomputing its work in a backup.\n", index, describeExit(status, reason, sizeof(reason)));
+    if (spawnShmChild(run, redo) != 0) {
+        fprintf(stderr, "No backup child is left to recompute the work of child process %d.\n", index);
+        return -1;
+    }
+    return 0;
+}
+
+/* Gives a backup to each child that has spent far longer on its current
+ * block than blocks take on average. Each block is backed up once per
+ * copy that stalls on it. */
+static void backUpStragglers(ShmRun *run) {
+    uint64_t blocks = 0, busyNs = 0;
+    for (int i = 0; i < run->nWorkers; i++) {
+        blocks += atomic_load_explicit(&run->segment->slots[i].progress.blocks, memory_order_acquire);
+        busyNs += atomic_load_explicit(&run->segment->slots[i].progress.busyNs, memory_order_relaxed);
+    }
+    if (blocks == 0) {
+        return;
+    }
+    uint64_t now = monotonicNs(), limit = stragglerLimit(busyNs / blocks);
+    for (int i = 0; i < run->nWorkers; i++) {
+        WorkerProgress *progress = &run->segment->slots[i].progress;
+        uint64_t block = atomic_load_explicit(&progress->block, memory_order_acquire);
+        uint64_t claimedNs = atomic_load_explicit(&progress->claimedNs, memory_order_relaxed);
+        if (run->pids[i] <= 0 || block == 0 || run->backedUp[i] == block || blockFinished(run->queue, block - 1)
+            || now < claimedNs || now - claimedNs <= limit) {
+            continue;
+        }
+        run->backedUp[i] = block;
+        if (spawnShmChild(run, (long)(block - 1)) == 0) {
+            fprintf(stderr, "Child process %d is straggling on block %llu, started backup child %d.\n", i, (unsigned long long)(block - 1), run->nWorkers - 1);
+        }
+    }
+}
+
+/* With every child gone and the futex still pending, some block was lost
+ * without a child to replace. A backup redoes the first unfinished one;
+ * the next pass picks up any other. */
+static int redoLostBlock(ShmRun *run) {
+    for (int i = 0; i < run->nWorkers; i++) {
+        if (run->pids[i] > 0) {
+            return 0;
+        }
+    }
+    for (uint64_t block = 0; block < run->queue->blocks; block++) {
+        if (!blockFinished(run->queue, block)) {
+            fprintf(stderr, "Block %llu was left unfinished, recomputing it in a backup.\n", (unsigned long long)block);
+            if (spawnShmChild(run, (long)block) != 0) {
+                fprintf(stderr, "No backup child is left to recompute block %llu.\n", (unsigned long long)block);
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/* Blocks on the segment's futex until every block of the queue is stored.
+ * While waiting it reaps children, replacing any that ended abnormally so
+ * their work is recomputed rather than missing, and backs up stragglers.
+ * Reaped pids are zeroed. */
+static int superviseChildren(ShmRun *run) {
+    while (completionWait(&run->segment->completion, COMPLETION_POLL_MS) != 0) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < run->nWorkers; i++) {
+                if (run->pids[i] == pid) {
+                    run->pids[i] = 0;
+                    if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && replaceChild(run, i, status) != 0) {
+                        return -1;
+                    }
+                }
+            }
+        }
+        if (redoLostBlock(run) != 0) {
+            return -1;
+        }
+        backUpStragglers(run);
+    }
+    return 0;
+}
+
+/* Once every block is stored, a child still on a block is a copy that lost
+ * it to a backup and is killed. The rest are only publishing their stats,
+ * so they get MIN_STRAGGLER_NS to exit before they are killed too. */
+static void reapWorkers(ShmRun *run, int failed) {
+    for (int i = 0; i < run->nWorkers; i++) {
+        if (run->pids[i] > 0 && (failed || atomic_load_explicit(&run->segment->slots[i].progress.block, memory_order_acquire) != 0)) {
+            kill(run->pids[i], SIGKILL);
+        }
+    }
+    uint64_t deadline = monotonicNs() + MIN_STRAGGLER_NS;
+    for (int live = 1; live;) {
+        live = 0;
+        for (int i = 0; i < run->nWorkers; i++) {
+            if (run->pids[i] > 0 && waitpid(run->pids[i], NULL, WNOHANG) == 0) {
+                live = 1;
+            } else {
+                run->pids[i] = 0;
+            }
+        }
+        if (live && monotonicNs() > deadline) {
+            for (int i = 0; i < run->nWorkers; i++) {
+                if (run->pids[i] > 0) {
+                    kill(run->pids[i], SIGKILL);
+                }
+            }
+            reapChildren(run->pids, run->nWorkers);
+            live = 0;
+        } else if (live) {
+            usleep(1000);
+        }
+    }
+}
+
+/* Prints the reduction when total is NULL, otherwise stores it there. The
+ * work queue follows layout when it is not NULL. */
+int runSharedMemoryChildren(const char *inputSpec, size_t count, int nChildren, const BlockLayout *layout, ReductionState *total) {
+    uint64_t mark = monotonicNs();
+    int nSlots = nChildren + MAX_BACKUP_CHILDREN;
+    size_t segmentSize = resultSegmentSize(nSlots) + (layout != NULL ? workQueueBytes(layout->blocks, 1) : workQueueSize(count));
+    SharedSegment segment;
+    if (createSegment(&segment, segmentSize, "Result") != 0) {
+        perror("Unable to create the result segment");
+        return -1;
+    }
+    ShmRun run = { inputSpec, "", count, nChildren, nSlots, 0, NULL, NULL, segment.base, NULL };
+    segmentSpec(&segment, run.resultSpec, sizeof(run.resultSpec));
+    inheritSegment(&segment);
+
+    memset(run.segment, 0, segmentSize);
+    run.queue = (WorkQueue *)&run.segment->slots[nSlots];
+    if (layout != NULL) {
+        workQueueInitEnds(run.queue, layout->ends, layout->blocks);
+    } else {
+        workQueueInit(run.queue, count);
+    }
+    completionReset(&run.segment->completion, (uint32_t)run.queue->blocks);
+
+    run.pids = calloc(nSlots, sizeof(pid_t));
+    run.backedUp = calloc(nSlots, sizeof(uint64_t));
+    if (run.pids == NULL || run.backedUp == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        destroySegment(&segment);
+        return -1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < nChildren && !failed; i++) {
+        failed = spawnShmChild(&run, -1) != 0;
+    }
+    mark = recordPhase("fork children", PHASE_SPAWN, mark);
+
+    failed = failed || superviseChildren(&run) != 0;
+    mark = recordPhase("await completion", PHASE_COMPUTE, mark);
+
+    reapWorkers(&run, failed);
+    mark = recordPhase("reap children", PHASE_COLLECT, mark);
+
+    if (!failed) {
+        ReductionState merged;
+        workQueueTotal(run.queue, &merged);
+        if (layout != NULL) {
+            memcpy(layout->partials, run.queue->partials, layout->blocks * sizeof(ReductionState));
+        }
+        if (total != NULL) {
+            *total = merged;
+        } else {
+            printReduction(&reduction, &merged);
+            fflush(stdout);
+        }
+        for (int i = 0; i < run.nWorkers; i++) {
+            if (resultReady(&run.segment->slots[i])) {
+                recordWorker(i, &run.segment->slots[i].stats);
+            }
+        }
+        recordPhase("merge", PHASE_COLLECT, mark);
+    }
+
+    free(run.pids);
+    free(run.backedUp);
+    destroySegment(&segment);
+    return failed ? -1 : 0;
+}
+
+/* One pipe child and the blocks sent to it, oldest first. It answers them
+ * in the order they went out, so the oldest is the one it is reducing. */
+typedef struct {
+    pid_t pid;
+    int inputFd;
+    int resultFd;
+    int sending;
+    int reported;
+    int nInFlight;
+    size_t inFlight[PIPE_BLOCKS_IN_FLIGHT];
+    uint64_t frontNs;
+    FrameWriter writer;
+    ResultReader reader;
+    WorkerStats stats;
+} PipeChild;
+
+/* Blocks of a pipe run: fresh ones are handed out from next, and blocks
+ * taken back from a failed or straggling child wait in redo. */
+typedef struct {
+    const char *numbers;
+    size_t count;
+    size_t blocks;
+    size_t next;
+    size_t *redo;
+    size_t nRedo;
+    char *done;
+    char *backedUp;
+    ReductionState *partials;
+} PipeBlocks;
+
+/* Pipes are close-on-exec, so a child started late does not inherit the
+ * ends that belong to its siblings. */
+static int spawnPipeChild(PipeChild *child, int index, int nChildren) {
+    int input[2], result[2];
+    if (pipe2(input, O_CLOEXEC) != 0) {
+        perror("pipe failed");
+        return -1;
+    }
+    if (pipe2(result, O_CLOEXEC) != 0) {
+        perror("pipe failed");
+        close(input[READ_END]);
+        close(input[WRITE_END]);
+        return -1;
+    }
+    growPipe(input[WRITE_END]);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(input[READ_END], STDIN_FILENO);
+        dup2(result[WRITE_END], STDOUT_FILENO);
+        if (index < nChildren) {
+            pinWorker(index, nChildren);
+        }
+        execl("./child_process", "child_process", "pipe", reductionOps, elementTypeName(reduction.elementType), (char *)NULL);
+        perror("execl failed");
+        exit(EXIT_FAILURE);
+    }
+    close(input[READ_END]);
+    close(result[WRITE_END]);
+    if (pid < 0) {
+        perror("fork failed");
+        close(input[WRITE_END]);
+        close(result[READ_END]);
+        return -1;
+    }
+
+    memset(child, 0, sizeof(*child));
+    child->pid = pid;
+    child->inputFd = input[WRITE_END];
+    child->resultFd = result[READ_END];
+    setNonBlocking(child->inputFd);
+    setNonBlocking(child->resultFd);
+    return 0;
+}
+
+static void closePipeChild(PipeChild *child) {
+    close(child->inputFd);
+    close(child->resultFd);
+    child->inputFd = -1;
+}
+
+static int holdsBlock(const PipeChild *child, size_t block) {
+    for (int i = 0; i < child->nInFlight; i++) {
+        if (child->inFlight[i] == block) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Starts sending the child its next block, a redo one it does not already
+ * hold first. Returns 0 when there is nothing left to give it. */
+static int sendNextBlock(PipeChild *child, PipeBlocks *run) {
+    size_t block = run->blocks;
+    for (size_t i = 0; i < run->nRedo; i++) {
+        if (run->done[run->redo[i]]) {
+            run->redo[i--] = run->redo[--run->nRedo];
+        } else if (!holdsBlock(child, run->redo[i])) {
+            block = run->redo[i];
+            run->redo[i] = run->redo[--run->nRedo];
+            break;
+        }
+    }
+    if (block == run->blocks && run->next < run->blocks) {
+        block = run->next++;
+    }
+    if (block == run->blocks) {
+        return 0;
+    }
+
+    size_t width = elementSize(reduction.elementType);
+    size_t start = block * WORK_BLOCK_SIZE;
+    size_t length = run->count - start < WORK_BLOCK_SIZE ? run->count - start : WORK_BLOCK_SIZE;
+    frameWriterInit(&child->writer, run->numbers + start * width, length * width);
+    if (child->nInFlight == 0) {
+        child->frontNs = monotonicNs();
+    }
+    child->inFlight[child->nInFlight++] = block;
+    child->sending = 1;
+    return 1;
+}
+
+/* Puts the child's unfinished blocks back for the others to take, once
+ * each. */
+static void takeBackBlocks(PipeChild *child, PipeBlocks *run) {
+    for (int i = 0; i < child->nInFlight; i++) {
+        size_t block = child->inFlight[i], r = 0;
+        while (r < run->nRedo && run->redo[r] != block) {
+            r++;
+        }
+        if (!run->done[block] && r == run->nRedo) {
+            run->redo[run->nRedo++] = block;
+        }
+    }
+}
+
+/*
+ * Hands the input out to the children in WORK_BLOCK_SIZE blocks, each as
+ * DATA frames and an END, to whichever child has room: every child holds
+ * up to PIPE_BLOCKS_IN_FLIGHT blocks, so it reduces one while the next is
+ * sent, and answers each with a RESULT. The partials are merged in block
+ * order, the same as the shm method's, so the result does not depend on
+ * which child took which block. A child killed by a signal, or one that
+ * failed after reporting blocks, has its blocks taken back and is replaced;
+ * one that fails before any is taken to fail the same way every time. A
+ * child that has spent STRAGGLER_FACTOR times longer on its current block
+ * than blocks take has its blocks handed to the others as well and gets a
+ * backup, and whichever copy answers first counts.
+ */
+void executeWithPipes(const void *numbers, size_t count, int nChildren) {
+    uint64_t mark = monotonicNs();
+    PipeBlocks run = { numbers, count, (count + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE, 0, NULL, 0, NULL, NULL, NULL };
+    int capacity = nChildren + MAX_BACKUP_CHILDREN, nSpawned = 0;
+    PipeChild *children = calloc(capacity, sizeof(PipeChild));
+    struct pollfd *fds = malloc(2 * capacity * sizeof(struct pollfd));
+    int *owners = malloc(2 * capacity * sizeof(int));
+    run.redo = malloc((run.blocks > 0 ? run.blocks : 1) * sizeof(size_t));
+    run.done = calloc(run.blocks, 1);
+    run.backedUp = calloc(run.blocks, 1);
+    run.partials = malloc(run.blocks * sizeof(ReductionState));
+    if (children == NULL || fds == NULL || owners == NULL || run.redo == NULL || run.done == NULL || run.backedUp == NULL || run.partials == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int failed = 0;
+    for (int i = 0; i < nChildren && !failed; i++) {
+        failed = spawnPipeChild(&children[nSpawned], i, nChildren) != 0;
+        nSpawned += !failed;
+    }
+    mark = recordPhase("fork children", PHASE_SPAWN, mark);
+
+    /* Children reduce while the input is still being sent, so compute is
+     * only the wait for results after the last block went out. */
+    uint64_t sentNs = mark, busyNs = 0;
+    size_t finished = 0;
+    while (!failed && finished < run.blocks) {
+        int nfds = 0;
+        for (int k = 0; k < nSpawned; k++) {
+            PipeChild *child = &children[k];
+            if (child->inputFd == -1) {
+                continue;
+            }
+            if (child->sending || (child->nInFlight < PIPE_BLOCKS_IN_FLIGHT && sendNextBlock(child, &run))) {
+                fds[nfds] = (struct pollfd){ child->inputFd, POLLOUT, 0 };
+                owners[nfds++] = k;
+            }
+            if (child->nInFlight > 0) {
+                fds[nfds] = (struct pollfd){ child->resultFd, POLLIN, 0 };
+                owners[nfds++] = k;
+            }
+        }
+        if (poll(fds, nfds, COMPLETION_POLL_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int f = 0; f < nfds && !failed && finished < run.blocks; f++) {
+            int k = owners[f];
+            PipeChild *child = &children[k];
+            if (fds[f].revents == 0 || child->inputFd == -1) {
+                continue;
+            }
+            int status;
+            if (fds[f].events == POLLOUT) {
+                status = frameWriterPump(&child->writer, child->inputFd);
+                if (status > 0) {
+                    child->sending = 0;
+                    if (run.next == run.blocks && run.nRedo == 0) {
+                        sentNs = monotonicNs();
+                    }
                 }
+            } else {
+                status = readResult(&child->reader, child->resultFd);
+                if (status > 0) {
+                    size_t block = child->inFlight[0];
+                    uint64_t now = monotonicNs();
+                    memmove(child->inFlight, child->inFlight + 1, --child->nInFlight * sizeof(size_t));
+                    workerStatsMerge(&child->stats, &child->reader.result.stats);
+                    child->reported = 1;
+                    if (!run.done[block]) {
+                        run.done[block] = 1;
+                        run.partials[block] = child->reader.result.state;
+                        busyNs += now - child->frontNs;
+                        finished++;
+                    }
+                    child->frontNs = now;
+                    memset(&child->reader, 0, sizeof(child->reader));
+                }
+            }
+            if (status >= 0) {
+                continue;
             }
 
-            close(pipes[i][WRITE_END]);
-            close(resultPipes[i][READ_END]);
+            int exitStatus;
+            char reason[48];
+            closePipeChild(child);
+            waitpid(child->pid, &exitStatus, 0);
+            child->pid = 0;
+            if (!WIFSIGNALED(exitStatus) && !child->reported) {
+                /* It failed on its own, as every copy of it would. */
+                fprintf(stderr, "Child process %d failed (%s) before reporting a block.\n", k, describeExit(exitStatus, reason, sizeof(reason)));
+                failed = 1;
+                break;
+            }
+            fprintf(stderr, "Child process %d failed (%s), recomputing its blocks in a backup.\n", k, describeExit(exitStatus, reason, sizeof(reason)));
+            takeBackBlocks(child, &run);
+            child->nInFlight = 0;
+            if (nSpawned == capacity || spawnPipeChild(&children[nSpawned], nSpawned, nChildren) != 0) {
+                int live = 0;
+                for (int i = 0; i < nSpawned; i++) {
+                    live += children[i].inputFd != -1;
+                }
+                if (live == 0) {
+                    fprintf(stderr, "No backup child is left to recompute the blocks of child process %d.\n", k);
+                    failed = 1;
+                }
+                continue;
+            }
+            nSpawned++;
+        }
 
-            dup2(pipes[i][READ_END], STDIN_FILENO);
-            dup2(resultPipes[i][WRITE_END], STDOUT_FILENO);
+        uint64_t now = monotonicNs();
+        for (int k = 0; k < nSpawned && finished > 0; k++) {
+            PipeChild *child = &children[k];
+            if (child->inputFd == -1 || child->nInFlight == 0 || run.backedUp[child->inFlight[0]]
+                || now - child->frontNs <= stragglerLimit(busyNs / finished)) {
+                continue;
+            }
+            for (int i = 0; i < child->nInFlight; i++) {
+                run.backedUp[child->inFlight[i]] = 1;
+            }
+            takeBackBlocks(child, &run);
+            if (nSpawned < capacity && spawnPipeChild(&children[nSpawned], nSpawned, nChildren) == 0) {
+                fprintf(stderr, "Child process %d is straggling on block %zu, started backup child %d.\n", k, child->inFlight[0], nSpawned);
+                nSpawned++;
+            }
+        }
+    }
+    recordSpan("send input", PHASE_TRANSFER, mark, sentNs);
+    mark = recordPhase("await results", PHASE_COMPUTE, sentNs);
+
+    /* Closing the input ends every idle child. Copies still on a block lost
+     * it to another child, or the run failed. */
+    for (int k = 0; k < nSpawned; k++) {
+        if (children[k].inputFd != -1) {
+            if (failed || children[k].nInFlight > 0) {
+                kill(children[k].pid, SIGKILL);
+            }
+            closePipeChild(&children[k]);
+        }
+    }
+    ReductionState total;
+    reductionInit(&total);
+    for (int k = 0; k < nSpawned; k++) {
+        if (children[k].pid > 0) {
+            waitpid(children[k].pid, NULL, 0);
+        }
+        if (children[k].reported) {
+            recordWorker(k, &children[k].stats);
+        }
+    }
+    for (size_t i = 0; i < run.blocks && !failed; i++) {
+        reductionMerge(&total, &run.partials[i]);
+    }
+    recordPhase("reap children", PHASE_COLLECT, mark);
+
+    free(children);
+    free(fds);
+    free(owners);
+    free(run.redo);
+    free(run.done);
+    free(run.backedUp);
+    free(run.partials);
+    if (failed) {
+        exit(EXIT_FAILURE);
+    }
+    printReduction(&reduction, &total);
+}
 
-            close(pipes[i][READ_END]);
-            close(resultPipes[i][WRITE_END]);
 
-            char childIndexStr[10];
+size_t executeWithParallelParse(const char *fileName, const InputFile *input, int nChildren) {
+    size_t maxChildren = input->size / MIN_PARSE_CHUNK_BYTES;
+    if (maxChildren < 1) {
+        maxChildren = 1;
+    }
+    if ((size_t)nChildren > maxChildren) {
+        nChildren = (int)maxChildren;
+        printf("Warning: Number of child processes adjusted to %d to match input size constraints.\n", nChildren);
+    }
+
+    uint64_t mark = monotonicNs();
+    SharedSegment segment;
+    if (createSegment(&segment, resultSegmentSize(nChildren), "Result") != 0) {
+        perror("Unable to create the result segment");
+        exit(EXIT_FAILURE);
+    }
+    ResultSegment *resultSegment = segment.base;
+    char resultSpec[SEGMENT_SPEC_SIZE];
+    segmentSpec(&segment, resultSpec, sizeof(resultSpec));
+    inheritSegment(&segment);
+    memset(resultSegment, 0, resultSegmentSize(nChildren));
+    completionReset(&resultSegment->completion, nChildren);
+    ResultSlot *results = resultSegment->slots;
+
+    pid_t *pids = calloc(nChildren, sizeof(pid_t));
+    if (pids == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t chunkStart = 0;
+    for (int i = 0; i < nChildren; i++) {
+        size_t chunkEnd = i == nChildren - 1
+            ? input->size
+            : alignToToken(input->data, input->size, input->size / nChildren * (i + 1));
+        if (chunkEnd < chunkStart) {
+            chunkEnd = chunkStart;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            char startStr[24], endStr[24], childIndexStr[20];
+            sprintf(startStr, "%zu", chunkStart);
+            sprintf(endStr, "%zu", chunkEnd);
             sprintf(childIndexStr, "%d", i);
-            execl("./child_process", "child_process", "pipe", childIndexStr, (char *)NULL);
+            pinWorker(i, nChildren);
+            execl("./child_process", "child_process", "text", fileName, startStr, endStr, resultSpec, childIndexStr, reductionOps, elementTypeName(reduction.elementType), (char *)NULL);
             perror("execl failed");
             exit(EXIT_FAILURE);
         }
+        pids[i] = pid;
+        chunkStart = chunkEnd;
     }
+    mark = recordPhase("fork children", PHASE_SPAWN, mark);
 
-    for (int i = 0; i < nChildren; i++) {
-        close(pipes[i][READ_END]);
-        close(resultPipes[i][WRITE_END]);
+    int failed = awaitCompletion(resultSegment, pids, nChildren) != 0;
+    mark = recordPhase("await completion", PHASE_COMPUTE, mark);
+    reapChildren(pids, nChildren);
+    free(pids);
+    mark = recordPhase("reap children", PHASE_COLLECT, mark);
 
-        int start = i * segmentSize + (i < remainder ? i : remainder);
-        int end = start + segmentSize + (i < remainder ? 1 : 0);
-        for (int j = start; j < end; j++) {
-            write(pipes[i][WRITE_END], &numbers[j], sizeof(numbers[j]));
+    ReductionState total;
+    reductionInit(&total);
+    for (int i = 0; i < nChildren && !failed; i++) {
+        if (!resultReady(&results[i])) {
+            failed = 1;
+            break;
+        }
+        reductionMerge(&total, &results[i].state);
+        recordWorker(i, &results[i].stats);
+        if (!results[i].complete) {
+            break;
         }
-        close(pipes[i][WRITE_END]);
     }
+    recordPhase("merge", PHASE_COLLECT, mark);
 
-    for (int i = 0; i < nChildren; i++) {
-        float result;
-        read(resultPipes[i][READ_END], &result, sizeof(result));
-        totalSum += result;
-        close(resultPipes[i][READ_END]);
+    destroySegment(&segment);
+
+    if (failed) {
+        fprintf(stderr, "A child process failed to parse its part of the file.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (total.count < 2) {
+        fprintf(stderr, "The file must contain at least 2 numbers.\n");
+        exit(EXIT_FAILURE);
     }
+    printReduction(&reduction, &total);
+    return total.count;
+}
 
-    for (int i = 0; i < nChildren; i++) {
-        wait(NULL);
+
+static void *sumBlocks(void *arg) {
+    ThreadTask *task = arg;
+    pinWorker(task->index, task->nThreads);
+    workerStatsBegin(&task->stats);
+    size_t block, start, end;
+    while (claimBlock(task->queue, &block, &start, &end)) {
+        size_t width = elementSize(task->spec->elementType);
+        reduceRange(task->spec, task->numbers + start * width, end - start, &task->queue->partials[block]);
+        task->stats.bytes += (end - start) * width;
+        task->stats.units++;
     }
+    workerStatsFinish(&task->stats, 1);
+    return NULL;
+}
 
-    printf("Total sum of squares: %f\n", totalSum);
+void executeWithThreads(const void *numbers, size_t count, int nThreads) {
+    uint64_t mark = monotonicNs();
+    pthread_t *threads = malloc(nThreads * sizeof(pthread_t));
+    ThreadTask *tasks = malloc(nThreads * sizeof(ThreadTask));
+    size_t queueSize = (workQueueSize(count) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    WorkQueue *queue = aligned_alloc(CACHE_LINE_SIZE, queueSize);
+    if (threads == NULL || tasks == NULL || queue == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    workQueueInit(queue, count);
 
-    for (int i = 0; i < nChildren; i++) {
-        free(pipes[i]);
-        free(resultPipes[i]);
+    for (int i = 0; i < nThreads; i++) {
+        tasks[i].numbers = numbers;
+        tasks[i].spec = &reduction;
+        tasks[i].queue = queue;
+        tasks[i].index = i;
+        tasks[i].nThreads = nThreads;
+        int rc = pthread_create(&threads[i], NULL, sumBlocks, &tasks[i]);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create failed: %s\n", strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    mark = recordPhase("start threads", PHASE_SPAWN, mark);
+
+    for (int i = 0; i < nThreads; i++) {
+        pthread_join(threads[i], NULL);
+        recordWorker(i, &tasks[i].stats);
     }
-    free(pipes);
-    free(resultPipes);
-}
\ No newline at end of file
+    mark = recordPhase("join threads", PHASE_COMPUTE, mark);
+    ReductionState total;
+    workQueueTotal(queue, &total);
+    printReduction(&reduction, &total);
+    recordPhase("merge", PHASE_COLLECT, mark);
+
+    free(threads);
+    free(tasks);
+    free(queue);
+}
@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include "pipe_protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+static int spliceAvailable = 1;
+
+static void waitForFd(int fd, short events) {
+    struct pollfd pfd = { fd, events, 0 };
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
+}
+
+int writeAll(int fd, const void *buffer, size_t length) {
+    const char *p = buffer;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                waitForFd(fd, POLLOUT);
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+ssize_t readAll(int fd, void *buffer, size_t length) {
+    char *p = buffer;
+    size_t total = 0;
+    while (total < length) {
+        ssize_t n = read(fd, p + total, length - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                waitForFd(fd, POLLIN);
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+void growPipe(int fd) {
+#ifdef F_SETPIPE_SZ
+    fcntl(fd, F_SETPIPE_SZ, PIPE_FRAME_BYTES);
+#else
+    (void)fd;
+#endif
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static int splicePayload(int fd, const void *payload, size_t length) {
+    struct iovec iov = { (void *)payload, length };
+    while (iov.iov_len > 0) {
+        ssize_t n = vmsplice(fd, &iov, 1, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                waitForFd(fd, POLLOUT);
+                continue;
+            }
+            if (iov.iov_len == length && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                spliceAvailable = 0;
+                return writeAll(fd, payload, length);
+            }
+            return -1;
+        }
+        iov.iov_base = (char *)iov.iov_base + n;
+        iov.iov_len -= (size_t)n;
+    }
+    return 0;
+}
+
+int sendFrame(int fd, uint32_t type, const void *payload, size_t length) {
+    FrameHeader header = { type, 0, length };
+    if (writeAll(fd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (spliceAvailable && type == FRAME_DATA) {
+        return splicePayload(fd, payload, length);
+    }
+    return writeAll(fd, payload, length);
+}
+
+int receiveFrameHeader(int fd, FrameHeader *header) {
+    ssize_t n = readAll(fd, header, sizeof(*header));
+    if (n < 0) {
+        return -1;
+    }
+    return n == (ssize_t)sizeof(*header) ? 1 : 0;
+}
+
+static void frameWriterNext(FrameWriter *writer) {
+    size_t length = writer->remaining < PIPE_FRAME_BYTES ? writer->remaining : PIPE_FRAME_BYTES;
+    writer->header.type = length > 0 ? FRAME_DATA : FRAME_END;
+    writer->header.reserved = 0;
+    writer->header.length = length;
+    writer->headerSent = 0;
+    writer->payload = writer->next;
+    writer->payloadLeft = length;
+    writer->next += length;
+    writer->remaining -= length;
+}
+
+void frameWriterInit(FrameWriter *writer, const void *numbers, size_t length) {
+    writer->next = numbers;
+    writer->remaining = length;
+    frameWriterNext(writer);
+}
+
+/* Writes until the pipe is full. Returns 1 once the END frame is out, 0 if
+ * the fd would block and -1 on error. The fd must be non-blocking. */
+int frameWriterPump(FrameWriter *writer, int fd) {
+    for (;;) {
+        ssize_t n;
+        if (writer->headerSent < sizeof(writer->header)) {
+            n = write(fd, (const char *)&writer->header + writer->headerSent, sizeof(writer->header) - writer->headerSent);
+        } else if (writer->payloadLeft > 0) {
+            if (spliceAvailable) {
+                struct iovec iov = { (void *)writer->payload, writer->payloadLeft };
+                n = vmsplice(fd, &iov, 1, SPLICE_F_NONBLOCK);
+                if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                    spliceAvailable = 0;
+                    continue;
+                }
+            } else {
+                n = write(fd, writer->payload, writer->payloadLeft);
+            }
+        } else if (writer->header.type == FRAME_END) {
+            return 1;
+        } else {
+            frameWriterNext(writer);
+            continue;
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (writer->headerSent < sizeof(writer->header)) {
+            writer->headerSent += (size_t)n;
+        } else {
+            writer->payload += n;
+            writer->payloadLeft -= (size_t)n;
+        }
+    }
+}
+
+/* Reads a RESULT frame without blocking. Returns 1 when complete, 0 if
+ * more data is needed and -1 if the child closed the pipe early. */
+int readResult(ResultReader *reader, int fd) {
+    for (;;) {
+        ssize_t n = read(fd, reader->buffer + reader->received, sizeof(reader->buffer) - reader->received);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        reader->received += (size_t)n;
+        if (reader->received == sizeof(reader->buffer)) {
+            break;
+        }
+    }
+    if (reader->received < sizeof(reader->buffer)) {
+        return -1;
+    }
+
+    FrameHeader header;
+    memcpy(&header, reader->buffer, sizeof(header));
+    if (header.type != FRAME_RESULT || header.length != sizeof(WorkerResult)) {
+        return -1;
+    }
+    memcpy(&reader->result, reader->buffer + sizeof(header), sizeof(WorkerResult));
+    return 1;
+}
+
+/* Drives n children at once: pumps each writer (if any) into its
+ * non-blocking input fd and collects one RESULT frame from each result fd.
+ * When sentNs is not NULL it receives the time the last byte of input
+ * went out. Returns 0 when every child reported, -1 otherwise. */
+int exchangeFrames(int n, const int *inputFds, const int *resultFds, FrameWriter *writers, WorkerResult *results, uint64_t *sentNs) {
+    ResultReader *readers = calloc(n, sizeof(ResultReader));
+    struct pollfd *fds = malloc(2 * n * sizeof(struct pollfd));
+    int *fdOwners = malloc(2 * n * sizeof(int));
+    char *writing = malloc(n);
+    char *reading = malloc(n);
+    if (readers == NULL || fds == NULL || fdOwners == NULL || writing == NULL || reading == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int pending = 0, sending = 0;
+    for (int i = 0; i < n; i++) {
+        writing[i] = writers != NULL;
+        reading[i] = 1;
+        reductionInit(&results[i].state);
+        memset(&results[i].stats, 0, sizeof(WorkerStats));
+        pending += writing[i] + reading[i];
+        sending += writing[i];
+    }
+    if (sentNs != NULL && sending == 0) {
+        *sentNs = monotonicNs();
+    }
+
+    int failed = 0;
+    while (pending > 0) {
+        int nfds = 0;
+        for (int i = 0; i < n; i++) {
+            if (writing[i]) {
+                fds[nfds].fd = inputFds[i];
+                fds[nfds].events = POLLOUT;
+                fdOwners[nfds++] = i;
+            }
+            if (reading[i]) {
+                fds[nfds].fd = resultFds[i];
+                fds[nfds].events = POLLIN;
+                fdOwners[nfds++] = i;
+            }
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int k = 0; k < nfds; k++) {
+            int i = fdOwners[k];
+            if (fds[k].revents == 0) {
+                continue;
+            }
+            if (fds[k].events == POLLOUT) {
+                int status = frameWriterPump(&writers[i], inputFds[i]);
+                if (status != 0) {
+                    if (status < 0) {
+                        fprintf(stderr, "Write to child process %d failed: %s\n", i, strerror(errno));
+                    }
+                    writing[i] = 0;
+                    pending--;
+                    if (--sending == 0 && sentNs != NULL) {
+                        *sentNs = monotonicNs();
+                    }
+                }
+            } else {
+                int status = readResult(&readers[i], resultFds[i]);
+                if (status != 0) {
+                    if (status < 0) {
+                        fprintf(stderr, "Child process %d did not report a result.\n", i);
+                        failed = 1;
+                    } else {
+                        results[i] = readers[i].result;
+                    }
+                    reading[i] = 0;
+                    pending--;
+                }
+            }
+        }
+    }
+
+    free(readers);
+    free(fds);
+    free(fdOwners);
+    free(writing);
+    free(reading);
+    return failed ? -1 : 0;
+}
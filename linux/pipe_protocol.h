@@ -0,0 +1,60 @@
+#ifndef PIPE_PROTOCOL_H
+#define PIPE_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "instrument.h"
+#include "reduction.h"
+
+#define PIPE_FRAME_BYTES (1 << 20)
+
+enum {
+    FRAME_DATA = 1,
+    FRAME_END = 2,
+    FRAME_RESULT = 3,
+    FRAME_JOB = 4
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t length;
+} FrameHeader;
+
+typedef struct {
+    const char *next;
+    size_t remaining;
+    FrameHeader header;
+    size_t headerSent;
+    const char *payload;
+    size_t payloadLeft;
+} FrameWriter;
+
+/* Payload of a RESULT frame. */
+typedef struct {
+    ReductionState state;
+    WorkerStats stats;
+} WorkerResult;
+
+typedef struct {
+    char buffer[sizeof(FrameHeader) + sizeof(WorkerResult)];
+    size_t received;
+    WorkerResult result;
+} ResultReader;
+
+int writeAll(int fd, const void *buffer, size_t length);
+ssize_t readAll(int fd, void *buffer, size_t length);
+void growPipe(int fd);
+void setNonBlocking(int fd);
+
+int sendFrame(int fd, uint32_t type, const void *payload, size_t length);
+int receiveFrameHeader(int fd, FrameHeader *header);
+
+void frameWriterInit(FrameWriter *writer, const void *numbers, size_t length);
+int frameWriterPump(FrameWriter *writer, int fd);
+int readResult(ResultReader *reader, int fd);
+int exchangeFrames(int n, const int *inputFds, const int *resultFds, FrameWriter *writers, WorkerResult *results, uint64_t *sentNs);
+
+#endif
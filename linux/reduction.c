@@ -0,0 +1,237 @@
+#include "reduction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define REDUCTION_BLOCK_SIZE 2048
+
+static const struct {
+    const char *name;
+    uint32_t op;
+} opNames[] = {
+    { "sum", OP_SUM },
+    { "sumsq", OP_SUM_SQUARES },
+    { "mean", OP_MEAN },
+    { "var", OP_VARIANCE },
+    { "min", OP_MIN },
+    { "max", OP_MAX },
+    { "l2", OP_L2_NORM }
+};
+
+static int parseHistogram(const char *text, ReductionSpec *spec) {
+    char *end;
+    spec->low = strtod(text, &end);
+    if (end == text || *end != ':') {
+        return -1;
+    }
+    text = end + 1;
+    spec->high = strtod(text, &end);
+    if (end == text || !(spec->low < spec->high) || !isfinite(spec->high - spec->low)) {
+        return -1;
+    }
+    spec->bins = DEFAULT_HISTOGRAM_BINS;
+    if (*end == ':') {
+        text = end + 1;
+        long bins = strtol(text, &end, 10);
+        if (end == text || bins < 1 || bins > MAX_HISTOGRAM_BINS) {
+            return -1;
+        }
+        spec->bins = (uint32_t)bins;
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+/* Comma-separated list of sum, sumsq, mean, var, min, max, l2 and
+ * hist:<low>:<high>[:<bins>]. */
+int parseReductionSpec(const char *text, int elementType, ReductionSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->elementType = (uint32_t)elementType;
+    char *copy = strdup(text);
+    if (copy == NULL) {
+        return -1;
+    }
+    int rc = 0;
+    char *saved;
+    for (char *token = strtok_r(copy, ",", &saved); token != NULL && rc == 0; token = strtok_r(NULL, ",", &saved)) {
+        if (strncmp(token, "hist:", 5) == 0) {
+            rc = parseHistogram(token + 5, spec);
+            spec->ops |= OP_HISTOGRAM;
+            continue;
+        }
+        rc = -1;
+        for (size_t i = 0; i < sizeof(opNames) / sizeof(opNames[0]); i++) {
+            if (strcmp(token, opNames[i].name) == 0) {
+                spec->ops |= opNames[i].op;
+                rc = 0;
+            }
+        }
+    }
+    free(copy);
+    return rc == 0 && spec->ops != 0 ? 0 : -1;
+}
+
+void reductionInit(ReductionState *state) {
+    memset(state, 0, sizeof(*state));
+    state->minimum = INFINITY;
+    state->maximum = -INFINITY;
+}
+
+void reductionMerge(ReductionState *into, const ReductionState *from) {
+    if (from->count == 0) {
+        return;
+    }
+    double total = (double)into->count + (double)from->count;
+    double delta = from->mean - into->mean;
+    into->mean += delta * (double)from->count / total;
+    into->m2 += from->m2 + delta * delta * (double)into->count * (double)from->count / total;
+    into->count += from->count;
+    into->sum += from->sum;
+    into->sumSquares += from->sumSquares;
+    into->minimum = from->minimum < into->minimum ? from->minimum : into->minimum;
+    into->maximum = from->maximum > into->maximum ? from->maximum : into->maximum;
+    into->below += from->below;
+    into->above += from->above;
+    for (int i = 0; i < MAX_HISTOGRAM_BINS; i++) {
+        into->histogram[i] += from->histogram[i];
+    }
+}
+
+/* Everything except the squares for one cache-sized block, before
+ * state->count includes it. The block is read a second time for its M2,
+ * which then hits L1 rather than memory. */
+static void scanBlock(const ReductionSpec *spec, ReductionState *state, const double *block, size_t count) {
+    if (spec->ops & (OP_SUM | OP_MEAN | OP_VARIANCE)) {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += block[i];
+        }
+        state->sum += sum;
+
+        double mean = sum / (double)count, m2 = 0;
+        if (spec->ops & OP_VARIANCE) {
+            for (size_t i = 0; i < count; i++) {
+                double d = block[i] - mean;
+                m2 += d * d;
+            }
+        }
+        double total = (double)state->count + (double)count;
+        double delta = mean - state->mean;
+        state->mean += delta * (double)count / total;
+        state->m2 += m2 + delta * delta * (double)state->count * (double)count / total;
+    }
+
+    if (spec->ops & (OP_MIN | OP_MAX)) {
+        double minimum = state->minimum, maximum = state->maximum;
+        for (size_t i = 0; i < count; i++) {
+            minimum = block[i] < minimum ? block[i] : minimum;
+            maximum = block[i] > maximum ? block[i] : maximum;
+        }
+        state->minimum = minimum;
+        state->maximum = maximum;
+    }
+
+    if (spec->ops & OP_HISTOGRAM) {
+        /* Branch-free binning into slots where 0 is below and bins + 1 is
+         * above. NaN clamps into slot 0 and is taken back out afterwards. */
+        uint32_t counts[MAX_HISTOGRAM_BINS + 2] = { 0 };
+        uint32_t nans = 0;
+        double scale = spec->bins / (spec->high - spec->low);
+        double offset = 1.0 - spec->low * scale;
+        double last = spec->bins + 1;
+        uint32_t bins = spec->bins;
+        for (size_t i = 0; i < count; i++) {
+            double position = block[i] * scale + offset;
+            nans += position != position;
+            position = position > 0 ? position : 0;
+            position = position < last ? position : last;
+            counts[(int32_t)position]++;
+        }
+        state->below += counts[0] - nans;
+        state->above += counts[bins + 1];
+        for (uint32_t i = 0; i < bins; i++) {
+            state->histogram[i] += counts[i + 1];
+        }
+    }
+}
+
+void reducerInit(Reducer *reducer, const ReductionSpec *spec) {
+    reducer->spec = *spec;
+    reductionInit(&reducer->state);
+    sumStateInit(&reducer->squares);
+}
+
+void reducerUpdate(Reducer *reducer, const void *numbers, size_t count) {
+    int isDouble = reducer->spec.elementType == ELEMENT_FLOAT64;
+    if (reducer->spec.ops & (OP_SUM_SQUARES | OP_L2_NORM)) {
+        if (isDouble) {
+            sumStateUpdateDoubles(&reducer->squares, numbers, count);
+        } else {
+            sumStateUpdate(&reducer->squares, numbers, count);
+        }
+    }
+    if (reducer->spec.ops & ~(OP_SUM_SQUARES | OP_L2_NORM)) {
+        /* float32 blocks are widened first so one scan handles both types. */
+        double widened[REDUCTION_BLOCK_SIZE];
+        for (size_t offset = 0; offset < count; offset += REDUCTION_BLOCK_SIZE) {
+            size_t length = count - offset < REDUCTION_BLOCK_SIZE ? count - offset : REDUCTION_BLOCK_SIZE;
+            const double *block = (const double *)numbers + offset;
+            if (!isDouble) {
+                for (size_t i = 0; i < length; i++) {
+                    widened[i] = ((const float *)numbers)[offset + i];
+                }
+                block = widened;
+            }
+            scanBlock(&reducer->spec, &reducer->state, block, length);
+            reducer->state.count += length;
+        }
+    } else {
+        reducer->state.count += count;
+    }
+}
+
+void reducerFinish(Reducer *reducer, ReductionState *state) {
+    *state = reducer->state;
+    state->sumSquares += sumStateResult(&reducer->squares);
+}
+
+void reduceRange(const ReductionSpec *spec, const void *numbers, size_t count, ReductionState *state) {
+    Reducer reducer;
+    reducerInit(&reducer, spec);
+    reducerUpdate(&reducer, numbers, count);
+    reducerFinish(&reducer, state);
+}
+
+void printReduction(const ReductionSpec *spec, const ReductionState *state) {
+    if (spec->ops & OP_SUM) {
+        printf("Sum: %f\n", state->sum);
+    }
+    if (spec->ops & OP_SUM_SQUARES) {
+        printf("Total sum of squares: %f\n", state->sumSquares);
+    }
+    if (spec->ops & OP_MEAN) {
+        printf("Mean: %f\n", state->mean);
+    }
+    if (spec->ops & OP_VARIANCE) {
+        printf("Variance: %f\n", state->count > 1 ? state->m2 / (double)(state->count - 1) : 0.0);
+    }
+    if (spec->ops & OP_MIN) {
+        printf("Minimum: %f\n", state->minimum);
+    }
+    if (spec->ops & OP_MAX) {
+        printf("Maximum: %f\n", state->maximum);
+    }
+    if (spec->ops & OP_L2_NORM) {
+        printf("L2 norm: %f\n", sqrt(state->sumSquares));
+    }
+    if (spec->ops & OP_HISTOGRAM) {
+        double width = (spec->high - spec->low) / spec->bins;
+        printf("Histogram over [%g, %g):\n", spec->low, spec->high);
+        for (uint32_t i = 0; i < spec->bins; i++) {
+            printf("  [%g, %g): %llu\n", spec->low + i * width, spec->low + (i + 1) * width,
+                   (unsigned long long)state->histogram[i]);
+        }
+        printf("  below: %llu\n  above: %llu\n", (unsigned long long)state->below, (unsigned long long)state->above);
+    }
+}
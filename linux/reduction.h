@@ -0,0 +1,74 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "element_type.h"
+#include "sum_kernel.h"
+
+#define MAX_HISTOGRAM_BINS 64
+#define DEFAULT_HISTOGRAM_BINS 16
+
+enum {
+    OP_SUM = 1 << 0,
+    OP_SUM_SQUARES = 1 << 1,
+    OP_MEAN = 1 << 2,
+    OP_VARIANCE = 1 << 3,
+    OP_MIN = 1 << 4,
+    OP_MAX = 1 << 5,
+    OP_L2_NORM = 1 << 6,
+    OP_HISTOGRAM = 1 << 7
+};
+
+/* Which reductions to compute over which element type. Plain data, so it
+ * can travel in a JOB frame. */
+typedef struct {
+    uint32_t ops;
+    uint32_t elementType;
+    uint32_t bins;
+    double low;
+    double high;
+} ReductionSpec;
+
+/*
+ * Partial result over some elements. Every field merges associatively, so
+ * partials from any backend can be combined; mean and m2 use the
+ * Chan/Welford merge. Plain data, so it can sit in shared memory or be sent
+ * in a RESULT frame.
+ */
+typedef struct {
+    uint64_t count;
+    double sum;
+    double sumSquares;
+    double mean;
+    double m2;
+    double minimum;
+    double maximum;
+    uint64_t below;
+    uint64_t above;
+    uint64_t histogram[MAX_HISTOGRAM_BINS];
+} ReductionState;
+
+/* Accumulates one contiguous stream of updates. Squares go through the SIMD
+ * kernel's float64 lanes, so their total does not depend on how the stream
+ * was cut, whatever the element type. */
+typedef struct {
+    ReductionSpec spec;
+    ReductionState state;
+    SumState squares;
+} Reducer;
+
+#define DEFAULT_REDUCTION_OPS "sumsq"
+
+int parseReductionSpec(const char *text, int elementType, ReductionSpec *spec);
+void reductionInit(ReductionState *state);
+void reductionMerge(ReductionState *into, const ReductionState *from);
+void printReduction(const ReductionSpec *spec, const ReductionState *state);
+
+void reducerInit(Reducer *reducer, const ReductionSpec *spec);
+void reducerUpdate(Reducer *reducer, const void *numbers, size_t count);
+void reducerFinish(Reducer *reducer, ReductionState *state);
+void reduceRange(const ReductionSpec *spec, const void *numbers, size_t count, ReductionState *state);
+
+#endif
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include "shared_segment.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+
+#ifndef SHM_HUGETLB
+#define SHM_HUGETLB 04000
+#endif
+
+static int hugePagesRequested = 0;
+static int useMemfd = 1;
+
+static size_t hugePageSize(void) {
+    FILE *file = fopen("/proc/meminfo", "r");
+    size_t sizeKb = 0;
+    if (file) {
+        char line[128];
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "Hugepagesize: %zu kB", &sizeKb) == 1) {
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return sizeKb > 0 ? sizeKb * 1024 : 2 * 1024 * 1024;
+}
+
+void setHugePages(int enabled) {
+    hugePagesRequested = enabled;
+}
+
+int setSegmentTransport(const char *name) {
+    if (strcmp(name, "memfd") == 0) {
+        useMemfd = 1;
+    } else if (strcmp(name, "sysv") == 0) {
+        useMemfd = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* shmget(IPC_PRIVATE) that tries SHM_HUGETLB first when huge pages were
+ * requested, and reports on stderr which page size the segment ended up
+ * with. */
+int createSharedSegment(size_t size, const char *label) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (!hugePagesRequested) {
+        return shmget(IPC_PRIVATE, size, IPC_CREAT | 0666);
+    }
+
+    size_t pageSize = hugePageSize();
+    size_t rounded = (size + pageSize - 1) / pageSize * pageSize;
+    int shmID = shmget(IPC_PRIVATE, rounded, IPC_CREAT | SHM_HUGETLB | 0666);
+    if (shmID != -1) {
+        fprintf(stderr, "%s segment: %zu kB huge pages\n", label, pageSize / 1024);
+        return shmID;
+    }
+
+    int hugeError = errno;
+    shmID = shmget(IPC_PRIVATE, size, IPC_CREAT | 0666);
+    if (shmID != -1) {
+        fprintf(stderr, "%s segment: huge pages unavailable (%s), using %ld kB pages\n",
+                label, strerror(hugeError), sysconf(_SC_PAGESIZE) / 1024);
+    }
+    return shmID;
+}
+
+/* shmat that additionally asks for transparent huge pages, which covers the
+ * fallback case where the segment could not use hugetlb pages. */
+void *attachSharedSegment(int shmID, size_t size) {
+    void *base = shmat(shmID, NULL, 0);
+    if (base != (void *)-1 && hugePagesRequested) {
+#ifdef MADV_HUGEPAGE
+        madvise(base, size, MADV_HUGEPAGE);
+#else
+        (void)size;
+#endif
+    }
+    return base;
+}
+
+static int mapMemfd(SharedSegment *segment, size_t size, unsigned int flags, const char *label) {
+    segment->fd = memfd_create(label, MFD_CLOEXEC | MFD_ALLOW_SEALING | flags);
+    if (segment->fd == -1) {
+        return -1;
+    }
+    if (ftruncate(segment->fd, (off_t)size) == 0) {
+        segment->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        if (segment->base != MAP_FAILED) {
+            return 0;
+        }
+    }
+    int error = errno;
+    close(segment->fd);
+    segment->fd = -1;
+    errno = error;
+    return -1;
+}
+
+/* Creates a segment of size bytes and maps it read-write in the parent.
+ * A memfd tries MFD_HUGETLB first when huge pages were requested, with the
+ * same fallback and stderr report as the SysV path; hugetlb pages are only
+ * reserved at mmap time, so that is where the fallback is decided. */
+int createSegment(SharedSegment *segment, size_t size, const char *label) {
+    if (size == 0) {
+        size = 1;
+    }
+    segment->size = size;
+    segment->shmID = -1;
+    segment->fd = -1;
+    if (!useMemfd) {
+        segment->shmID = createSharedSegment(size, label);
+        if (segment->shmID == -1) {
+            return -1;
+        }
+        segment->base = attachSharedSegment(segment->shmID, size);
+        if (segment->base == (void *)-1) {
+            shmctl(segment->shmID, IPC_RMID, NULL);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (hugePagesRequested) {
+        size_t pageSize = hugePageSize();
+        size_t rounded = (size + pageSize - 1) / pageSize * pageSize;
+        if (mapMemfd(segment, rounded, MFD_HUGETLB, label) == 0) {
+            segment->size = rounded;
+            fprintf(stderr, "%s segment: %zu kB huge pages\n", label, pageSize / 1024);
+            return 0;
+        }
+        fprintf(stderr, "%s segment: huge pages unavailable (%s), using %ld kB pages\n",
+                label, strerror(errno), sysconf(_SC_PAGESIZE) / 1024);
+    }
+    if (mapMemfd(segment, size, 0, label) != 0) {
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugePagesRequested) {
+        madvise(segment->base, size, MADV_HUGEPAGE);
+    }
+#endif
+    return 0;
+}
+
+/* How a child names the segment on its command line or in a JOB frame:
+ * "fd:<n>" for an inherited memfd, the bare shmID otherwise. */
+void segmentSpec(const SharedSegment *segment, char *buffer, size_t length) {
+    if (segment->fd != -1) {
+        snprintf(buffer, length, "fd:%d", segment->fd);
+    } else {
+        snprintf(buffer, length, "%d", segment->shmID);
+    }
+}
+
+/* Lets children started from now on inherit the memfd across exec. */
+void inheritSegment(const SharedSegment *segment) {
+    if (segment->fd != -1) {
+        fcntl(segment->fd, F_SETFD, 0);
+    }
+}
+
+/* Drops the parent's writable mapping and seals a memfd against writes and
+ * resizing, so children can only ever map it read-only. */
+int sealSegment(SharedSegment *segment) {
+    if (segment->fd == -1) {
+        return 0;
+    }
+    munmap(segment->base, segment->size);
+    segment->base = NULL;
+    return fcntl(segment->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+}
+
+void destroySegment(SharedSegment *segment) {
+    if (segment->fd != -1) {
+        if (segment->base != NULL) {
+            munmap(segment->base, segment->size);
+        }
+        close(segment->fd);
+    } else {
+        shmdt(segment->base);
+        shmctl(segment->shmID, IPC_RMID, NULL);
+    }
+}
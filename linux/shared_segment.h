@@ -0,0 +1,30 @@
+#ifndef SHARED_SEGMENT_H
+#define SHARED_SEGMENT_H
+
+#include <stddef.h>
+
+/*
+ * A segment the parent shares with children it starts afterwards. With the
+ * memfd transport (the default) fd is inherited across exec and the segment
+ * disappears with its last fd or mapping, even if the parent crashes; with
+ * the sysv transport shmID is used and removed in destroySegment.
+ */
+typedef struct {
+    int shmID;
+    int fd;
+    void *base;
+    size_t size;
+} SharedSegment;
+
+void setHugePages(int enabled);
+int setSegmentTransport(const char *name);
+int createSharedSegment(size_t size, const char *label);
+void *attachSharedSegment(int shmID, size_t size);
+
+int createSegment(SharedSegment *segment, size_t size, const char *label);
+void segmentSpec(const SharedSegment *segment, char *buffer, size_t length);
+void inheritSegment(const SharedSegment *segment);
+int sealSegment(SharedSegment *segment);
+void destroySegment(SharedSegment *segment);
+
+#endif
@@ -0,0 +1,402 @@
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "binary_format.h"
+#include "common.h"
+#include "number_parser.h"
+#include "pipe_protocol.h"
+#include "shared_segment.h"
+#include "worker_pool.h"
+
+#define STREAM_CHUNK_BYTES (4 << 20)
+#define STREAM_READ_BYTES (1 << 20)
+#define CHUNKS_PER_WORKER 2
+
+enum {
+    CHUNK_FREE,
+    CHUNK_QUEUED,
+    CHUNK_BUSY,
+    CHUNK_DONE
+};
+
+typedef struct {
+    int state;
+    uint64_t sequence;
+    size_t count;
+    ReductionState partial;
+} StreamChunk;
+
+/*
+ * Reads text or binary input from a file or pipe in bounded pieces. Text is
+ * parsed only up to the last whitespace in the buffer, so a token split
+ * across two reads is carried over and parsed once it is complete.
+ */
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t start;
+    size_t end;
+    int eof;
+    int finished;
+    int binary;
+    int swapped;
+    int elementType;
+    uint64_t remaining;
+} ChunkReader;
+
+static int fillBuffer(ChunkReader *reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == reader->capacity) {
+        char *grown = realloc(reader->buffer, reader->capacity * 2);
+        if (grown == NULL) {
+            return -1;
+        }
+        reader->buffer = grown;
+        reader->capacity *= 2;
+    }
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    reader->end += (size_t)n;
+    reader->eof = n == 0;
+    return 0;
+}
+
+/* Text is parsed as elementType; binary input keeps the type in its header. */
+static int openChunkReader(ChunkReader *reader, const char *fileName, int elementType) {
+    memset(reader, 0, sizeof(*reader));
+    reader->elementType = elementType;
+    reader->fd = strcmp(fileName, "-") == 0 ? STDIN_FILENO : open(fileName, O_RDONLY);
+    if (reader->fd == -1) {
+        perror("Unable to open the file");
+        return -1;
+    }
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    reader->capacity = STREAM_READ_BYTES;
+    reader->buffer = malloc(reader->capacity);
+    if (reader->buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    while (reader->end < BINARY_HEADER_SIZE && !reader->eof) {
+        if (fillBuffer(reader) != 0) {
+            perror("read failed");
+            return -1;
+        }
+    }
+    if (!isBinaryInput(reader->buffer, reader->end)) {
+        return 0;
+    }
+
+    BinaryInfo binary;
+    const char *error;
+    if (readBinaryHeader(reader->buffer, SIZE_MAX, &binary, &error) != 0) {
+        fprintf(stderr, "Invalid binary input: %s.\n", error);
+        return -1;
+    }
+    reader->binary = 1;
+    reader->swapped = binary.swapped;
+    reader->elementType = binary.elementType;
+    reader->remaining = binary.count;
+    size_t skip = binary.dataOffset;
+    while (skip > reader->end - reader->start) {
+        skip -= reader->end - reader->start;
+        reader->start = reader->end;
+        if (reader->eof || fillBuffer(reader) != 0) {
+            fprintf(stderr, "Invalid binary input: header does not match the file size.\n");
+            return -1;
+        }
+    }
+    reader->start += skip;
+    return 0;
+}
+
+static void closeChunkReader(ChunkReader *reader) {
+    if (reader->fd > STDIN_FILENO) {
+        close(reader->fd);
+    }
+    free(reader->buffer);
+}
+
+static ssize_t readBinaryChunk(ChunkReader *reader, void *numbers, size_t capacity) {
+    size_t wanted = reader->remaining < capacity ? (size_t)reader->remaining : capacity;
+    size_t bytes = wanted * elementSize(reader->elementType);
+    size_t buffered = reader->end - reader->start;
+    if (buffered > bytes) {
+        buffered = bytes;
+    }
+    memcpy(numbers, reader->buffer + reader->start, buffered);
+    reader->start += buffered;
+    if (bytes > buffered && readAll(reader->fd, (char *)numbers + buffered, bytes - buffered) != (ssize_t)(bytes - buffered)) {
+        fprintf(stderr, "Invalid binary input: header does not match the file size.\n");
+        return -1;
+    }
+    if (reader->swapped) {
+        swapElements(numbers, numbers, wanted, reader->elementType);
+    }
+    reader->remaining -= wanted;
+    reader->finished = reader->remaining == 0;
+    return (ssize_t)wanted;
+}
+
+static ssize_t readTextChunk(ChunkReader *reader, void *numbers, size_t capacity) {
+    size_t width = elementSize(reader->elementType);
+    size_t count = 0;
+    while (count < capacity && !reader->finished) {
+        size_t limit = reader->end;
+        if (!reader->eof) {
+            while (limit > reader->start && !isspace((unsigned char)reader->buffer[limit - 1])) {
+                limit--;
+            }
+        }
+        const char *stop;
+        count += parseElements(reader->buffer + reader->start, reader->buffer + limit,
+                               (char *)numbers + count * width, reader->elementType, capacity - count, &stop);
+        reader->start = (size_t)(stop - reader->buffer);
+        if (count == capacity) {
+            break;
+        }
+        if (reader->start < limit || reader->eof) {
+            reader->finished = 1;
+            break;
+        }
+        if (fillBuffer(reader) != 0) {
+            perror("read failed");
+            return -1;
+        }
+    }
+    return (ssize_t)count;
+}
+
+/* Fills numbers with up to capacity elements; fewer only at the end of input. */
+static ssize_t readChunk(ChunkReader *reader, void *numbers, size_t capacity) {
+    if (reader->finished) {
+        return 0;
+    }
+    return reader->binary ? readBinaryChunk(reader, numbers, capacity) : readTextChunk(reader, numbers, capacity);
+}
+
+static int dispatchChunk(WorkerPool *pool, const ReductionSpec *spec, int worker, const char *ringSpec, int index, StreamChunk *chunk) {
+    char payload[sizeof(WorkerJob) + 32];
+    size_t chunkElements = STREAM_CHUNK_BYTES / elementSize(spec->elementType);
+    WorkerJob job = { *spec, (uint64_t)index * chunkElements, chunk->count, 0, 1 };
+    memcpy(payload, &job, sizeof(job));
+    int specLength = snprintf(payload + sizeof(job), sizeof(payload) - sizeof(job), "%s", ringSpec);
+    if (sendFrame(pool->inputFds[worker], FRAME_JOB, payload, sizeof(job) + specLength) != 0) {
+        return -1;
+    }
+    chunk->state = CHUNK_BUSY;
+    return 0;
+}
+
+static int collectResult(WorkerPool *pool, int worker, StreamChunk *chunk) {
+    FrameHeader header;
+    WorkerResult result;
+    if (receiveFrameHeader(pool->resultFds[worker], &header) != 1 || header.type != FRAME_RESULT
+        || header.length != sizeof(WorkerResult)
+        || readAll(pool->resultFds[worker], &result, sizeof(WorkerResult)) != (ssize_t)sizeof(WorkerResult)) {
+        return -1;
+    }
+    chunk->partial = result.state;
+    chunk->state = CHUNK_DONE;
+    recordWorker(worker, &result.stats);
+    return 0;
+}
+
+static int nextQueuedChunk(const StreamChunk *chunks, int nChunks) {
+    int next = -1;
+    for (int i = 0; i < nChunks; i++) {
+        if (chunks[i].state == CHUNK_QUEUED && (next == -1 || chunks[i].sequence < chunks[next].sequence)) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+/* Gives the oldest queued chunks to idle workers. assigned[w] is -1 when idle. */
+static int dispatchQueued(WorkerPool *pool, const ReductionSpec *spec, const char *ringSpec, StreamChunk *chunks, int nChunks, int *assigned) {
+    for (int w = 0; w < pool->size; w++) {
+        int next;
+        if (assigned[w] != -1 || (next = nextQueuedChunk(chunks, nChunks)) == -1) {
+            continue;
+        }
+        if (dispatchChunk(pool, spec, w, ringSpec, next, &chunks[next]) != 0) {
+            fprintf(stderr, "Worker process %d failed.\n", w);
+            return -1;
+        }
+        assigned[w] = next;
+    }
+    return 0;
+}
+
+/*
+ * Streams the input through a ring of CHUNKS_PER_WORKER chunks per worker in
+ * one shared segment. The parent fills free chunks while pooled workers sum
+ * the ones already handed out, so memory stays bounded by the ring size.
+ * A chunk returns to the ring only once its partial has been merged, and
+ * partials are merged in input order, so the result does not depend on
+ * which worker finishes first.
+ */
+int executeStreaming(const char *fileName, int nChildren, const ReductionSpec *requested, size_t *streamed) {
+    ChunkReader reader;
+    if (openChunkReader(&reader, fileName, requested->elementType) != 0) {
+        closeChunkReader(&reader);
+        return -1;
+    }
+    ReductionSpec active = *requested;
+    active.elementType = (uint32_t)reader.elementType;
+    const ReductionSpec *spec = &active;
+    size_t chunkElements = STREAM_CHUNK_BYTES / elementSize(reader.elementType);
+
+    int nChunks = nChildren * CHUNKS_PER_WORKER;
+    size_t ringSize = (size_t)nChunks * STREAM_CHUNK_BYTES;
+    SharedSegment segment;
+    if (createSegment(&segment, ringSize, "Ring") != 0) {
+        perror("Unable to create the ring segment");
+        closeChunkReader(&reader);
+        return -1;
+    }
+    char *ring = segment.base;
+    char ringSpec[24];
+    segmentSpec(&segment, ringSpec, sizeof(ringSpec));
+    /* Pool workers started below inherit the ring. */
+    inheritSegment(&segment);
+
+    StreamChunk *chunks = calloc(nChunks, sizeof(StreamChunk));
+    int *assigned = malloc(nChildren * sizeof(int));
+    struct pollfd *fds = malloc(nChildren * sizeof(struct pollfd));
+    WorkerPool pool;
+    memset(&pool, 0, sizeof(pool));
+    signal(SIGPIPE, SIG_IGN);
+    int failed = chunks == NULL || assigned == NULL || fds == NULL;
+    uint64_t mark = monotonicNs();
+    if (failed) {
+        fprintf(stderr, "Memory allocation failed\n");
+    } else if (startPool(&pool, nChildren) != 0) {
+        failed = 1;
+    }
+    mark = recordPhase("start workers", PHASE_SPAWN, mark);
+
+    uint64_t filled = 0, merged = 0;
+    size_t count = 0;
+    ReductionState total;
+    reductionInit(&total);
+    int inputDone = 0;
+    for (int i = 0; i < nChildren && !failed; i++) {
+        assigned[i] = -1;
+    }
+
+    while (!failed) {
+        int canFill = 0;
+        for (int i = 0; i < nChunks && !inputDone && !failed; i++) {
+            if (chunks[i].state != CHUNK_FREE) {
+                continue;
+            }
+            ssize_t n = readChunk(&reader, ring + (size_t)i * STREAM_CHUNK_BYTES, chunkElements);
+            if (n < 0) {
+                failed = 1;
+                break;
+            }
+            if (n > 0) {
+                chunks[i].state = CHUNK_QUEUED;
+                chunks[i].sequence = filled++;
+                chunks[i].count = (size_t)n;
+                count += (size_t)n;
+            }
+            inputDone = reader.finished;
+            /* Hand the chunk out right away so it is summed while the next one is read. */
+            failed = dispatchQueued(&pool, spec, ringSpec, chunks, nChunks, assigned) != 0;
+        }
+        if (failed) {
+            break;
+        }
+
+        for (int i = 0; i < nChunks; i++) {
+            if (chunks[i].state == CHUNK_DONE && chunks[i].sequence == merged) {
+                reductionMerge(&total, &chunks[i].partial);
+                chunks[i].state = CHUNK_FREE;
+                merged++;
+                i = -1;
+            }
+        }
+        if (inputDone && merged == filled) {
+            break;
+        }
+
+        int nfds = 0;
+        for (int w = 0; w < nChildren; w++) {
+            if (assigned[w] != -1) {
+                fds[nfds].fd = pool.resultFds[w];
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+        }
+        for (int i = 0; i < nChunks && !inputDone; i++) {
+            canFill |= chunks[i].state == CHUNK_FREE;
+        }
+        /* Block only when there is no free chunk to read into. */
+        if (poll(fds, nfds, canFill ? 0 : -1) < 0 && errno != EINTR) {
+            perror("poll failed");
+            failed = 1;
+            break;
+        }
+        for (int w = 0, k = 0; w < nChildren && !failed; w++) {
+            if (assigned[w] == -1 || fds[k++].revents == 0) {
+                continue;
+            }
+            if (collectResult(&pool, w, &chunks[assigned[w]]) != 0) {
+                fprintf(stderr, "Worker process %d failed.\n", w);
+                failed = 1;
+                break;
+            }
+            assigned[w] = -1;
+        }
+        if (!failed) {
+            failed = dispatchQueued(&pool, spec, ringSpec, chunks, nChunks, assigned) != 0;
+        }
+    }
+
+    /* Reading, transfer and compute overlap, so the whole loop is compute. */
+    mark = recordPhase("stream", PHASE_COMPUTE, mark);
+    if (pool.pids != NULL) {
+        stopPool(&pool);
+    }
+    recordPhase("stop workers", PHASE_COLLECT, mark);
+    free(chunks);
+    free(assigned);
+    free(fds);
+    destroySegment(&segment);
+    closeChunkReader(&reader);
+
+    if (failed) {
+        return -1;
+    }
+    if (count < 2) {
+        fprintf(stderr, "The file must contain at least 2 numbers.\n");
+        return -1;
+    }
+    printReduction(spec, &total);
+    *streamed = count;
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+#include "reduction.h"
+
+int executeStreaming(const char *fileName, int nChildren, const ReductionSpec *requested, size_t *streamed);
+
+#endif
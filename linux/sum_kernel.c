@@ -0,0 +1,256 @@
+#include "sum_kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+/*
+ * Every kernel keeps SUM_LANES double accumulators and adds the square of
+ * element i to lane i % SUM_LANES. A float squared is exact in double, so
+ * the vector variants perform exactly the same additions as the scalar one
+ * and all of them produce bit-identical sums. The float64 kernels round
+ * each square once, the same way in every variant, so they agree as well.
+ * That only holds while the compiler keeps the multiply and the add apart:
+ * under target("avx512f") GCC would otherwise fuse them into an FMA that
+ * skips the rounding of the square, so contraction is off for this file.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+typedef void (*SumKernel)(double *lanes, const float *numbers, size_t groups);
+typedef void (*SumKernelDouble)(double *lanes, const double *numbers, size_t groups);
+
+static void sumGroupsScalar(double *lanes, const float *numbers, size_t groups) {
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES; k++) {
+            double x = numbers[k];
+            lanes[k] += x * x;
+        }
+        numbers += SUM_LANES;
+    }
+}
+
+static void sumGroupsScalarDouble(double *lanes, const double *numbers, size_t groups) {
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES; k++) {
+            lanes[k] += numbers[k] * numbers[k];
+        }
+        numbers += SUM_LANES;
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static void sumGroupsSse2(double *lanes, const float *numbers, size_t groups) {
+    __m128d acc[SUM_LANES / 2];
+    for (int k = 0; k < SUM_LANES / 2; k++) {
+        acc[k] = _mm_loadu_pd(lanes + 2 * k);
+    }
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES / 4; k++) {
+            __m128 v = _mm_loadu_ps(numbers + 4 * k);
+            __m128d lo = _mm_cvtps_pd(v);
+            __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+            acc[2 * k] = _mm_add_pd(acc[2 * k], _mm_mul_pd(lo, lo));
+            acc[2 * k + 1] = _mm_add_pd(acc[2 * k + 1], _mm_mul_pd(hi, hi));
+        }
+        numbers += SUM_LANES;
+    }
+    for (int k = 0; k < SUM_LANES / 2; k++) {
+        _mm_storeu_pd(lanes + 2 * k, acc[k]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sumGroupsAvx2(double *lanes, const float *numbers, size_t groups) {
+    __m256d acc[SUM_LANES / 4];
+    for (int k = 0; k < SUM_LANES / 4; k++) {
+        acc[k] = _mm256_loadu_pd(lanes + 4 * k);
+    }
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES / 8; k++) {
+            __m256 v = _mm256_loadu_ps(numbers + 8 * k);
+            __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            acc[2 * k] = _mm256_add_pd(acc[2 * k], _mm256_mul_pd(lo, lo));
+            acc[2 * k + 1] = _mm256_add_pd(acc[2 * k + 1], _mm256_mul_pd(hi, hi));
+        }
+        numbers += SUM_LANES;
+    }
+    for (int k = 0; k < SUM_LANES / 4; k++) {
+        _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sumGroupsAvx512(double *lanes, const float *numbers, size_t groups) {
+    __m512d acc0 = _mm512_loadu_pd(lanes);
+    __m512d acc1 = _mm512_loadu_pd(lanes + 8);
+    for (size_t g = 0; g < groups; g++) {
+        __m512d lo = _mm512_cvtps_pd(_mm256_loadu_ps(numbers));
+        __m512d hi = _mm512_cvtps_pd(_mm256_loadu_ps(numbers + 8));
+        acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(lo, lo));
+        acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(hi, hi));
+        numbers += SUM_LANES;
+    }
+    _mm512_storeu_pd(lanes, acc0);
+    _mm512_storeu_pd(lanes + 8, acc1);
+}
+
+__attribute__((target("sse2")))
+static void sumGroupsSse2Double(double *lanes, const double *numbers, size_t groups) {
+    __m128d acc[SUM_LANES / 2];
+    for (int k = 0; k < SUM_LANES / 2; k++) {
+        acc[k] = _mm_loadu_pd(lanes + 2 * k);
+    }
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES / 2; k++) {
+            __m128d v = _mm_loadu_pd(numbers + 2 * k);
+            acc[k] = _mm_add_pd(acc[k], _mm_mul_pd(v, v));
+        }
+        numbers += SUM_LANES;
+    }
+    for (int k = 0; k < SUM_LANES / 2; k++) {
+        _mm_storeu_pd(lanes + 2 * k, acc[k]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sumGroupsAvx2Double(double *lanes, const double *numbers, size_t groups) {
+    __m256d acc[SUM_LANES / 4];
+    for (int k = 0; k < SUM_LANES / 4; k++) {
+        acc[k] = _mm256_loadu_pd(lanes + 4 * k);
+    }
+    for (size_t g = 0; g < groups; g++) {
+        for (int k = 0; k < SUM_LANES / 4; k++) {
+            __m256d v = _mm256_loadu_pd(numbers + 4 * k);
+            acc[k] = _mm256_add_pd(acc[k], _mm256_mul_pd(v, v));
+        }
+        numbers += SUM_LANES;
+    }
+    for (int k = 0; k < SUM_LANES / 4; k++) {
+        _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sumGroupsAvx512Double(double *lanes, const double *numbers, size_t groups) {
+    __m512d acc0 = _mm512_loadu_pd(lanes);
+    __m512d acc1 = _mm512_loadu_pd(lanes + 8);
+    for (size_t g = 0; g < groups; g++) {
+        __m512d lo = _mm512_loadu_pd(numbers);
+        __m512d hi = _mm512_loadu_pd(numbers + 8);
+        acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(lo, lo));
+        acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(hi, hi));
+        numbers += SUM_LANES;
+    }
+    _mm512_storeu_pd(lanes, acc0);
+    _mm512_storeu_pd(lanes + 8, acc1);
+}
+#endif
+
+static SumKernel selectedKernel;
+static SumKernelDouble selectedKernelDouble;
+static const char *selectedKernelName;
+
+/* Runs before main, so every thread and child sees the kernels already
+ * chosen instead of racing to choose them on first use. */
+__attribute__((constructor))
+static void selectKernel(void) {
+    const char *forced = getenv("SP_SUM_KERNEL");
+    selectedKernel = sumGroupsScalar;
+    selectedKernelDouble = sumGroupsScalarDouble;
+    selectedKernelName = "scalar";
+    if (forced != NULL && strcmp(forced, "scalar") == 0) {
+        return;
+    }
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && (forced == NULL || strcmp(forced, "avx512") == 0)) {
+        selectedKernel = sumGroupsAvx512;
+        selectedKernelDouble = sumGroupsAvx512Double;
+        selectedKernelName = "avx512";
+    } else if (__builtin_cpu_supports("avx2") && (forced == NULL || strcmp(forced, "avx2") == 0 || strcmp(forced, "avx512") == 0)) {
+        selectedKernel = sumGroupsAvx2;
+        selectedKernelDouble = sumGroupsAvx2Double;
+        selectedKernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        selectedKernel = sumGroupsSse2;
+        selectedKernelDouble = sumGroupsSse2Double;
+        selectedKernelName = "sse2";
+    }
+#endif
+}
+
+const char *sumKernelName(void) {
+    return selectedKernelName;
+}
+
+void sumStateInit(SumState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+void sumStateUpdate(SumState *state, const float *numbers, size_t count) {
+    while (count > 0 && state->lane != 0) {
+        double x = *numbers++;
+        state->lanes[state->lane] += x * x;
+        state->lane = (state->lane + 1) % SUM_LANES;
+        count--;
+    }
+
+    size_t groups = count / SUM_LANES;
+    if (groups > 0) {
+        selectedKernel(state->lanes, numbers, groups);
+        numbers += groups * SUM_LANES;
+        count -= groups * SUM_LANES;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double x = numbers[i];
+        state->lanes[state->lane++] += x * x;
+    }
+}
+
+void sumStateUpdateDoubles(SumState *state, const double *numbers, size_t count) {
+    while (count > 0 && state->lane != 0) {
+        state->lanes[state->lane] += *numbers * *numbers;
+        numbers++;
+        state->lane = (state->lane + 1) % SUM_LANES;
+        count--;
+    }
+
+    size_t groups = count / SUM_LANES;
+    if (groups > 0) {
+        selectedKernelDouble(state->lanes, numbers, groups);
+        numbers += groups * SUM_LANES;
+        count -= groups * SUM_LANES;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        state->lanes[state->lane++] += numbers[i] * numbers[i];
+    }
+}
+
+double sumStateResult(const SumState *state) {
+    double lanes[SUM_LANES];
+    memcpy(lanes, state->lanes, sizeof(lanes));
+    for (int width = SUM_LANES / 2; width > 0; width /= 2) {
+        for (int k = 0; k < width; k++) {
+            lanes[k] += lanes[k + width];
+        }
+    }
+    return lanes[0];
+}
+
+double sumOfSquares(const float *numbers, size_t count) {
+    SumState state;
+    sumStateInit(&state);
+    sumStateUpdate(&state, numbers, count);
+    return sumStateResult(&state);
+}
@@ -0,0 +1,21 @@
+#ifndef SUM_KERNEL_H
+#define SUM_KERNEL_H
+
+#include <stddef.h>
+
+#define SUM_LANES 16
+
+typedef struct {
+    double lanes[SUM_LANES];
+    unsigned lane;
+} SumState;
+
+void sumStateInit(SumState *state);
+void sumStateUpdate(SumState *state, const float *numbers, size_t count);
+void sumStateUpdateDoubles(SumState *state, const double *numbers, size_t count);
+double sumStateResult(const SumState *state);
+
+double sumOfSquares(const float *numbers, size_t count);
+const char *sumKernelName(void);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+#define WORK_BLOCK_SIZE (1 << 16)
+
+/*
+ * Block cursor for dynamic scheduling. Workers claim fixed-size blocks with
+ * a fetch-add until the input runs out and store each block's partial at
+ * its index. Merging the partials in block order gives the same result no
+ * matter which worker took which block, or how many workers there were.
+ * A flag per block, after the partials, marks the ones stored through
+ * finishBlock, so a block can be handed to a second worker and counted once.
+ * A queue set up by workQueueInitEnds keeps each block's end offset between
+ * the two, for blocks that must not cross the boundaries of packed inputs.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t next;
+    uint64_t count;
+    uint64_t blocks;
+    uint64_t explicitEnds;
+    _Alignas(CACHE_LINE_SIZE) ReductionState partials[];
+} WorkQueue;
+
+static inline size_t workQueueBytes(size_t blocks, int explicitEnds) {
+    return sizeof(WorkQueue) + blocks * sizeof(ReductionState) + (explicitEnds ? blocks * sizeof(uint64_t) : 0) + blocks * sizeof(uint32_t);
+}
+
+static inline size_t workQueueSize(size_t count) {
+    return workQueueBytes((count + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE, 0);
+}
+
+static inline const uint64_t *blockEnds(const WorkQueue *queue) {
+    return (const uint64_t *)&queue->partials[queue->blocks];
+}
+
+static inline _Atomic uint32_t *blockFlags(WorkQueue *queue) {
+    return (_Atomic uint32_t *)(blockEnds(queue) + (queue->explicitEnds ? queue->blocks : 0));
+}
+
+static inline void workQueueInit(WorkQueue *queue, size_t count) {
+    atomic_store_explicit(&queue->next, 0, memory_order_relaxed);
+    queue->count = count;
+    queue->blocks = (count + WORK_BLOCK_SIZE - 1) / WORK_BLOCK_SIZE;
+    queue->explicitEnds = 0;
+    for (uint64_t i = 0; i < queue->blocks; i++) {
+        atomic_store_explicit(&blockFlags(queue)[i], 0, memory_order_relaxed);
+    }
+}
+
+/* Blocks end at ends[i], which must increase up to count. */
+static inline void workQueueInitEnds(WorkQueue *queue, const uint64_t *ends, size_t blocks) {
+    atomic_store_explicit(&queue->next, 0, memory_order_relaxed);
+    queue->count = blocks > 0 ? ends[blocks - 1] : 0;
+    queue->blocks = blocks;
+    queue->explicitEnds = 1;
+    memcpy((uint64_t *)blockEnds(queue), ends, blocks * sizeof(uint64_t));
+    for (uint64_t i = 0; i < queue->blocks; i++) {
+        atomic_store_explicit(&blockFlags(queue)[i], 0, memory_order_relaxed);
+    }
+}
+
+static inline void blockRange(const WorkQueue *queue, size_t block, size_t *start, size_t *end) {
+    if (queue->explicitEnds) {
+        *start = block > 0 ? (size_t)blockEnds(queue)[block - 1] : 0;
+        *end = (size_t)blockEnds(queue)[block];
+        return;
+    }
+    *start = block * WORK_BLOCK_SIZE;
+    *end = *start + WORK_BLOCK_SIZE < queue->count ? *start + WORK_BLOCK_SIZE : (size_t)queue->count;
+}
+
+static inline int claimBlock(WorkQueue *queue, size_t *block, size_t *start, size_t *end) {
+    uint64_t index = atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed);
+    if (index >= queue->blocks) {
+        return 0;
+    }
+    *block = (size_t)index;
+    blockRange(queue, *block, start, end);
+    return 1;
+}
+
+/* Like claimBlock, but names the block in owner, as block + 1, before the
+ * cursor moves past it. A worker killed between the two then never leaves
+ * a claimed block that nobody is known to hold; one that loses the race may
+ * name a block it never got, which at worst has that block done twice. */
+static inline int claimOwnedBlock(WorkQueue *queue, _Atomic uint64_t *owner, size_t *block, size_t *start, size_t *end) {
+    uint64_t index = atomic_load_explicit(&queue->next, memory_order_relaxed);
+    do {
+        if (index >= queue->blocks) {
+            atomic_store_explicit(owner, 0, memory_order_relaxed);
+            return 0;
+        }
+        atomic_store_explicit(owner, index + 1, memory_order_release);
+    } while (!atomic_compare_exchange_weak_explicit(&queue->next, &index, index + 1, memory_order_release, memory_order_relaxed));
+    *block = (size_t)index;
+    blockRange(queue, *block, start, end);
+    return 1;
+}
+
+/* Stores a block's partial and returns 1 if this was the first copy of the
+ * block to finish. Every copy computes the same bytes, so a later one
+ * rewriting the partial changes nothing. */
+static inline int finishBlock(WorkQueue *queue, size_t block, const ReductionState *partial) {
+    queue->partials[block] = *partial;
+    return atomic_exchange_explicit(&blockFlags(queue)[block], 1, memory_order_acq_rel) == 0;
+}
+
+static inline int blockFinished(WorkQueue *queue, size_t block) {
+    return atomic_load_explicit(&blockFlags(queue)[block], memory_order_acquire) != 0;
+}
+
+static inline void workQueueTotal(const WorkQueue *queue, ReductionState *total) {
+    reductionInit(total);
+    for (uint64_t i = 0; i < queue->blocks; i++) {
+        reductionMerge(total, &queue->partials[i]);
+    }
+}
+
+#endif
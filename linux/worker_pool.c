@@ -0,0 +1,456 @@
+#define _GNU_SOURCE
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "affinity.h"
+#include "binary_format.h"
+#include "common.h"
+#include "number_parser.h"
+#include "pipe_protocol.h"
+#include "shared_segment.h"
+
+#define READ_END 0
+#define WRITE_END 1
+#define MAX_REQUEST_SIZE (PATH_MAX + 64)
+
+typedef struct {
+    int shmID;
+    float *base;
+    size_t capacity;
+} Arena;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStopSignal(int signo) {
+    (void)signo;
+    stopRequested = 1;
+}
+
+static int startWorker(WorkerPool *pool, int i) {
+    int input[2], result[2];
+    if (pipe2(input, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (pipe2(result, O_CLOEXEC) != 0) {
+        close(input[READ_END]);
+        close(input[WRITE_END]);
+        return -1;
+    }
+    growPipe(input[WRITE_END]);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(input[READ_END]);
+        close(input[WRITE_END]);
+        close(result[READ_END]);
+        close(result[WRITE_END]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(input[READ_END], STDIN_FILENO);
+        dup2(result[WRITE_END], STDOUT_FILENO);
+        pinWorker(i, pool->size);
+        execl("./child_process", "child_process", "worker", (char *)NULL);
+        perror("execl failed");
+        exit(EXIT_FAILURE);
+    }
+
+    close(input[READ_END]);
+    close(result[WRITE_END]);
+    setNonBlocking(input[WRITE_END]);
+    setNonBlocking(result[READ_END]);
+    pool->pids[i] = pid;
+    pool->inputFds[i] = input[WRITE_END];
+    pool->resultFds[i] = result[READ_END];
+    return 0;
+}
+
+static void stopWorker(WorkerPool *pool, int i) {
+    if (pool->pids[i] <= 0) {
+        return;
+    }
+    close(pool->inputFds[i]);
+    close(pool->resultFds[i]);
+    kill(pool->pids[i], SIGTERM);
+    waitpid(pool->pids[i], NULL, 0);
+    pool->pids[i] = 0;
+}
+
+int startPool(WorkerPool *pool, int size) {
+    pool->size = size;
+    pool->pids = calloc(size, sizeof(pid_t));
+    pool->inputFds = calloc(size, sizeof(int));
+    pool->resultFds = calloc(size, sizeof(int));
+    if (pool->pids == NULL || pool->inputFds == NULL || pool->resultFds == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (int i = 0; i < size; i++) {
+        if (startWorker(pool, i) != 0) {
+            perror("Unable to start worker");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void stopPool(WorkerPool *pool) {
+    for (int i = 0; i < pool->size; i++) {
+        stopWorker(pool, i);
+    }
+    free(pool->pids);
+    free(pool->inputFds);
+    free(pool->resultFds);
+}
+
+static int restartWorkers(WorkerPool *pool, int parts) {
+    for (int i = 0; i < parts; i++) {
+        stopWorker(pool, i);
+        if (startWorker(pool, i) != 0) {
+            perror("Unable to restart worker");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int arenaReserve(Arena *arena, size_t count) {
+    if (count <= arena->capacity && arena->base != NULL) {
+        return 0;
+    }
+    size_t capacity = arena->capacity * 2 > count ? arena->capacity * 2 : count;
+    if (capacity == 0) {
+        capacity = 1;
+    }
+
+    int shmID = createSharedSegment(capacity * sizeof(float), "Arena");
+    if (shmID == -1) {
+        return -1;
+    }
+    float *base = (float *)attachSharedSegment(shmID, capacity * sizeof(float));
+    if (base == (void *)-1) {
+        shmctl(shmID, IPC_RMID, NULL);
+        return -1;
+    }
+
+    if (arena->base != NULL) {
+        shmdt(arena->base);
+        shmctl(arena->shmID, IPC_RMID, NULL);
+    }
+    arena->shmID = shmID;
+    arena->base = base;
+    arena->capacity = capacity;
+    return 0;
+}
+
+static void arenaRelease(Arena *arena) {
+    if (arena->base != NULL) {
+        shmdt(arena->base);
+        shmctl(arena->shmID, IPC_RMID, NULL);
+    }
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+static void reply(int client, const char *tag, const char *format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    dprintf(client, "%s %s\n", tag, message);
+}
+
+static int loadIntoArena(const char *fileName, Arena *arena, size_t *count, int client) {
+    InputFile input;
+    if (openInputFile(fileName, &input) != 0) {
+        reply(client, "ERR", "Unable to open the file: %s", strerror(errno));
+        return -1;
+    }
+
+    if (isBinaryInput(input.data, input.size)) {
+        BinaryInfo binary;
+        const char *error;
+        if (readBinaryHeader(input.data, input.size, &binary, &error) != 0) {
+            reply(client, "ERR", "Invalid binary input: %s.", error);
+            closeInputFile(&input);
+            return -1;
+        }
+        if (binary.elementType != ELEMENT_FLOAT32) {
+            reply(client, "ERR", "The server only accepts float32 input.");
+            closeInputFile(&input);
+            return -1;
+        }
+        if (arenaReserve(arena, binary.count) != 0) {
+            reply(client, "ERR", "Unable to grow the shared arena: %s", strerror(errno));
+            closeInputFile(&input);
+            return -1;
+        }
+        const float *data = (const float *)(input.data + binary.dataOffset);
+        if (binary.swapped) {
+            swapFloats(arena->base, data, binary.count);
+        } else {
+            memcpy(arena->base, data, binary.count * sizeof(float));
+        }
+        *count = binary.count;
+    } else {
+        float *parsed = parseAllElements(input.data, input.data + input.size, ELEMENT_FLOAT32, count, NULL);
+        if (parsed == NULL) {
+            reply(client, "ERR", "Memory allocation failed");
+            closeInputFile(&input);
+            return -1;
+        }
+        if (arenaReserve(arena, *count) != 0) {
+            reply(client, "ERR", "Unable to grow the shared arena: %s", strerror(errno));
+            free(parsed);
+            closeInputFile(&input);
+            return -1;
+        }
+        memcpy(arena->base, parsed, *count * sizeof(float));
+        free(parsed);
+    }
+
+    closeInputFile(&input);
+    return 0;
+}
+
+static int sendJobs(WorkerPool *pool, const Arena *arena, size_t count, int parts) {
+    char payload[sizeof(WorkerJob) + 32];
+    WorkerJob job = { { 0 }, 0, count, 0, (uint32_t)parts };
+    parseReductionSpec(DEFAULT_REDUCTION_OPS, ELEMENT_FLOAT32, &job.spec);
+    int specLength = snprintf(payload + sizeof(job), sizeof(payload) - sizeof(job), "%d", arena->shmID);
+    for (int i = 0; i < parts; i++) {
+        job.part = (uint32_t)i;
+        memcpy(payload, &job, sizeof(job));
+        if (sendFrame(pool->inputFds[i], FRAME_JOB, payload, sizeof(job) + specLength) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void handleJob(WorkerPool *pool, Arena *arena, int client, char *request) {
+    char method[16];
+    int requested, offset;
+    if (sscanf(request, "JOB %d %15s %n", &requested, method, &offset) != 2 || requested <= 0) {
+        reply(client, "ERR", "Malformed request.");
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        return;
+    }
+    const char *fileName = request + offset;
+    int useShm = strcmp(method, "shm") == 0;
+    if (!useShm && strcmp(method, "pipe") != 0) {
+        reply(client, "ERR", "Invalid IPC method. Please use 'shm' for shared memory or 'pipe' for pipes.");
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        return;
+    }
+
+    size_t count;
+    if (loadIntoArena(fileName, arena, &count, client) != 0) {
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        return;
+    }
+    if (count < 2) {
+        reply(client, "ERR", "The file must contain at least 2 numbers.");
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        return;
+    }
+
+    int parts = requested;
+    if (parts > pool->size) {
+        parts = pool->size;
+        reply(client, "OUT", "Warning: Number of child processes adjusted to %d to match the worker pool size.", parts);
+    }
+    if ((size_t)parts > count / 2) {
+        parts = (int)(count / 2);
+        reply(client, "OUT", "Warning: Number of child processes adjusted to %d to match input size constraints.", parts);
+    }
+
+    WorkerResult *results = malloc(parts * sizeof(WorkerResult));
+    FrameWriter *writers = useShm ? NULL : malloc(parts * sizeof(FrameWriter));
+    if (results == NULL || (!useShm && writers == NULL)) {
+        reply(client, "ERR", "Memory allocation failed");
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        free(results);
+        free(writers);
+        return;
+    }
+
+    int status;
+    if (useShm) {
+        status = sendJobs(pool, arena, count, parts);
+        if (status == 0) {
+            status = exchangeFrames(parts, pool->inputFds, pool->resultFds, NULL, results, NULL);
+        }
+    } else {
+        for (int i = 0; i < parts; i++) {
+            size_t start, end;
+            segmentBounds(count, parts, i, &start, &end);
+            frameWriterInit(&writers[i], arena->base + start, (end - start) * sizeof(float));
+        }
+        status = exchangeFrames(parts, pool->inputFds, pool->resultFds, writers, results, NULL);
+    }
+
+    if (status != 0) {
+        reply(client, "ERR", "A worker process failed, restarting the pool.");
+        reply(client, "EXIT", "%d", EXIT_FAILURE);
+        if (restartWorkers(pool, parts) != 0) {
+            stopRequested = 1;
+        }
+    } else {
+        ReductionState total;
+        reductionInit(&total);
+        for (int i = 0; i < parts; i++) {
+            reductionMerge(&total, &results[i].state);
+        }
+        reply(client, "OUT", "Total sum of squares: %f", total.sumSquares);
+        reply(client, "EXIT", "%d", EXIT_SUCCESS);
+    }
+    free(results);
+    free(writers);
+}
+
+static int openServerSocket(const char *socketPath) {
+    struct sockaddr_un address;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket failed");
+        return -1;
+    }
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        perror("Unable to listen on the socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static ssize_t readRequest(int client, char *request, size_t size) {
+    size_t length = 0;
+    while (length + 1 < size) {
+        ssize_t n = read(client, request + length, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        if (request[length] == '\n') {
+            break;
+        }
+        length++;
+    }
+    request[length] = '\0';
+    return (ssize_t)length;
+}
+
+int runServer(const char *socketPath, int poolSize) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    WorkerPool pool;
+    if (startPool(&pool, poolSize) != 0) {
+        stopPool(&pool);
+        return EXIT_FAILURE;
+    }
+
+    int server = openServerSocket(socketPath);
+    if (server == -1) {
+        stopPool(&pool);
+        return EXIT_FAILURE;
+    }
+    printf("Serving on %s with %d workers.\n", socketPath, poolSize);
+    fflush(stdout);
+
+    Arena arena = { -1, NULL, 0 };
+    char request[MAX_REQUEST_SIZE];
+    while (!stopRequested) {
+        int client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno != EINTR) {
+                perror("accept failed");
+            }
+            continue;
+        }
+        if (readRequest(client, request, sizeof(request)) > 0) {
+            handleJob(&pool, &arena, client, request);
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath);
+    arenaRelease(&arena);
+    stopPool(&pool);
+    return EXIT_SUCCESS;
+}
+
+int submitJob(const char *socketPath, const char *fileName, int nChildren, const char *ipcMethod) {
+    char absolutePath[PATH_MAX];
+    if (realpath(fileName, absolutePath) == NULL) {
+        perror("Unable to open the file");
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+        return EXIT_FAILURE;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Unable to connect to the server");
+        return EXIT_FAILURE;
+    }
+    dprintf(fd, "JOB %d %s %s\n", nChildren, ipcMethod, absolutePath);
+
+    FILE *replies = fdopen(fd, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    int exitCode = EXIT_FAILURE;
+    while (getline(&line, &capacity, replies) > 0) {
+        if (strncmp(line, "OUT ", 4) == 0) {
+            fputs(line + 4, stdout);
+        } else if (strncmp(line, "ERR ", 4) == 0) {
+            fputs(line + 4, stderr);
+        } else if (strncmp(line, "EXIT ", 5) == 0) {
+            exitCode = atoi(line + 5);
+            break;
+        }
+    }
+    free(line);
+    fclose(replies);
+    return exitCode;
+}
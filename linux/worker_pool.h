@@ -0,0 +1,21 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <sys/types.h>
+
+/* Long-lived "child_process worker" children, each fed JOB frames over its
+ * own input pipe and answering on its own result pipe (both non-blocking). */
+typedef struct {
+    int size;
+    pid_t *pids;
+    int *inputFds;
+    int *resultFds;
+} WorkerPool;
+
+int startPool(WorkerPool *pool, int size);
+void stopPool(WorkerPool *pool);
+
+int runServer(const char *socketPath, int poolSize);
+int submitJob(const char *socketPath, const char *fileName, int nChildren, const char *ipcMethod);
+
+#endif